@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <sys/wait.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -9,15 +10,79 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <wordexp.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <limits.h>
+
+struct sst_buffer;
 
 //declaring the builtin function names
-char *builtin_str[] = {"cd","help","exit"};
+char *builtin_str[] = {"cd","help","exit","timing","trace","shellstat","jobs","echo","hash","pipesize","pipestat","export","unset"};
 
 int sst_cd(char **args);
 int sst_help(char **args);
 int sst_exit(char **args);
+int sst_timing(char **args);
+int sst_pipesize(char **args);
+int sst_pipestat(char **args);
+int sst_trace(char **args);
+int sst_shellstat(char **args);
+int sst_jobs(char **args);
+int sst_echo(char **args);
+pid_t sst_fork(void);
+pid_t zygoteSpawn(char **args, int inFd, int outFd);
+void limitChild(void);
+void cgroupCleanup(void);
+int zygoteWait(pid_t pid, int *status, struct rusage *usage);
 int sst_execute(char **args);
 int sst_launch(char **args);
+int sst_wait(pid_t pid, char *command);
+double sst_elapsed_ms(struct timespec *start, struct timespec *end);
+char *sst_join_args(char **args);
+void sst_stats_begin(void);
+void sst_stats_end(void);
+void sst_stats_print(void);
+void sst_count_redirected(int fd);
+void traceCommand(char *line);
+void traceStop(void);
+void traceFlush(void);
+void traceFlushDue(void);
+int sst_getchar(void);
+void editorRawMode(void);
+void editorCookedMode(void);
+void editorShowLine(void);
+void jobAdd(pid_t pid, char **args);
+void jobFinished(pid_t pid, int status);
+void sst_join_group(pid_t pid);
+void sst_enforce_deadline(pid_t pid);
+void sst_restore_terminal(void);
+void sst_set_deadline(double seconds);
+double parseDuration(char *text);
+char *expandLine(char *line);
+char *unprotectWord(char *word);
+void unprotectArgs(char **args);
+unsigned int stringHash(const char *s);
+char *sst_getenv(const char *name);
+void varSet(const char *name, const char *value, int export);
+char **sst_environ(void);
+int sst_exec(char *path, char **args, char **envp);
+int sst_export(char **args);
+int sst_unset(char **args);
+int heredocApply(char *line, int *savedStdin);
+void heredocRestore(int savedStdin);
+int memoRun(char *line);
+int serveTransfer(int fd, char *data, size_t length, int writing);
+int dispatchCommand(char *line);
 char *sst_read_line(void);
 char **sst_split_line(char *line, char *s);
 int checkForCommands(char *line);
@@ -25,9 +90,16 @@ struct node* newNode(char *data);
 void historyPrint();
 void aliasFunc(char * line);
 char* checkAlias(char *line);
+void aliasSet(char *name, char *value, int mapped);
+struct aliasEntry *aliasFind(char *name);
+char *commandLookup(char *name);
+char *cacheDirectory(char *name);
+int sst_hash(char **args);
+void loadRcFile(void);
+void snapshotSave(void);
 int checkForCommands(char*);
-void editor();
-void executeCommandsFromEditor(char*);
+int editor();
+int executeCommandsFromEditor(char*);
 void cat2Function(char *line);
 void checkIFSyntax(char *line);
 void printZeroSizeFiles();
@@ -38,8 +110,13 @@ void pipeAndInput(char * line);
 void onlyRedirection(char *line);
 void readFromInputFile(char *line);
 void readFromOutputFile(char *line);
-void parsePipedInput(char **token);
+void parsePipedInput(char **token, int inFd, int outFd);
 void printFilesWithRegex(char *regex);
+void sst_buffer_init(struct sst_buffer *b);
+void sst_buffer_append(struct sst_buffer *b, const char *data, size_t n);
+void sst_buffer_putc(struct sst_buffer *b, char c);
+int sst_buffer_flush(struct sst_buffer *b, int fd);
+void sst_buffer_free(struct sst_buffer *b);
 
 int pipeInInputFlag = 0;
 int flag = 0;
@@ -47,14 +124,95 @@ int totalNodes = 0;
 int redirectionLessThan = 0;
 int redirectionGreaterThan = 0;
 int starFlag = 0;
-int aliasArrayCount = 0;
+int lastExitStatus = 0; //exit status of the last foreground command
+int statsDepth = 0; //nesting of checkForCommands, so a batch is accounted once
+sigset_t shellSignalMask; //signal mask to restore in children
+int zygoteFd = -1; //socket to the spawn helper, -1 when not in use
+
+int loadingRc = 0; //running the lines of ~/.ownshrc
+
+#define ALIAS_TABLE_SIZE 64
+#define COMMAND_TABLE_SIZE 256
+
+struct aliasEntry
+{
+      char *name;
+      char *value; //what the alias runs now
+      char *rcValue; //definition from the rc file, kept in the startup snapshot; NULL if none
+      int mapped; //name and rcValue point into the snapshot
+      struct aliasEntry *next;
+};
+struct aliasEntry *aliasTable[ALIAS_TABLE_SIZE];
+int aliasCount = 0;
+
+struct commandEntry //a program found in PATH
+{
+      char *name;
+      char *path;
+      int mapped;
+      struct commandEntry *next;
+};
+struct commandEntry *commandTable[COMMAND_TABLE_SIZE];
+int commandCount = 0;
+char *commandTablePath = NULL; //PATH the table was built for
+int commandTableDirty = 0; //changed since the snapshot was written
+
+struct shellOptions
+{
+      int timing; //report resource usage after every command
+      long pipeSize; //capacity of pipeline pipes, 0 for the kernel default
+      int pipeStats; //sample pipeline stages and report where they block
+} shellOptions;
+
+//Growable buffer used to stream text to a file or to the executor
+struct sst_buffer
+{
+      char *data;
+      size_t length;
+      size_t capacity;
+};
 
-struct alias
+//What a limited command's cgroup accounted, -1 where a file was missing
+struct cgroupUsage
 {
-  char *originalValue;
-  char *newValue;
+      int valid;
+      long long memoryPeak; //bytes
+      long long cpuUsec;
+      long long throttledUsec;
+      long long throttledCount;
 };
-struct alias *aliasArray ; //array of structures
+
+//Resource usage of one process of a command, collected with wait4
+struct stageStats
+{
+      pid_t pid;
+      char *command;
+      int status;
+      struct rusage usage;
+};
+
+//All processes started for the current command line
+struct commandStats
+{
+      struct stageStats *stages;
+      int stageCount;
+      int stageCapacity;
+      struct timespec start;
+      struct timespec end;
+      long long redirectedBytes;
+      int hasDeadline;
+      struct timespec deadline;
+      double timeoutSeconds;
+      pid_t pgid; //process group of a command with a deadline
+      int ownsTerminal;
+      int timedOut;
+      struct cgroupUsage cgroup; //set by limit
+} currentStats;
+
+//Here-document bodies of the command line being run, part of its memo key
+struct sst_buffer heredocBodies;
+int *heredocStageFds = NULL; //stdin of each stage of a pipeline with here-documents, -1 for none
+int heredocStageCount = 0;
 
 //For history
 struct node  
@@ -65,1034 +223,5997 @@ struct node
       struct node *prev;
 }*head,*tail;
 
-//getting the size of the builtin funtion array
-int sst_num_builtins() 
+/*
+  Hot path counters and latency histograms for the shellstat builtin. Only
+  the shell's one thread updates them, so the counters are plain integers.
+  Whether an exec worked is only known in the child, so children add to the
+  exec counts in a page they share with the shell, atomically. Histograms
+  are log-linear like HdrHistogram: 16 linear sub-buckets per power of two
+  keep every recorded microsecond value within about 6%.
+*/
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct latencyHistogram
 {
-      return sizeof(builtin_str) / sizeof(char *);
+      char *name;
+      unsigned long counts[HIST_BUCKETS];
+      unsigned long total;
+      unsigned long long sum;
+      unsigned long long max;
+};
+
+struct shellCounters
+{
+      unsigned long readBytes;
+      unsigned long readLines;
+      unsigned long tokens;
+      unsigned long tokenReallocs;
+      unsigned long forks;
+      unsigned long zygoteSpawns;
+      unsigned long dirEntries;
+      unsigned long globMatches;
+      unsigned long aliasLookups;
+      unsigned long memoHits;
+      unsigned long memoMisses;
+      unsigned long heredocPipes;
+      unsigned long heredocMemfds;
+} shellCounters;
+
+struct execCounters
+{
+      unsigned long attempts;
+      unsigned long failures; //exec returned, usually ENOENT
+} execCountersFallback, *execCounters = &execCountersFallback;
+
+//Maps the exec counts shared with every child. Runs before the zygote starts.
+void execCountersInit(void)
+{
+      void *page = mmap(NULL, sizeof(struct execCounters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if(page != MAP_FAILED)
+            execCounters = page;
 }
 
-int sst_cd(char **args)
+struct latencyHistogram parseLatency = {.name = "parse"};
+struct latencyHistogram spawnLatency = {.name = "spawn"};
+struct latencyHistogram waitLatency = {.name = "wait"};
+
+int histogramIndex(unsigned long long value)
 {
-      if (args[1] == NULL) 
-      {
-            fprintf(stderr, "sst: expected argument to \"cd\"\n");
-      } 
-      else 
-      {
-            if (chdir(args[1]) != 0) 
-            {
-                  perror("sst");
-            }
-      }
-      return 1;
+      int magnitude;
+
+      if(value < HIST_SUB_BUCKETS)
+            return value;
+      magnitude = 63 - __builtin_clzll(value);
+      return (magnitude - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + (int)((value >> (magnitude - HIST_SUB_BITS)) - HIST_SUB_BUCKETS);
 }
 
-int sst_help(char **args)
+//Smallest value that lands in the given bucket
+unsigned long long histogramValue(int index)
+{
+      int magnitude, sub;
+
+      if(index < HIST_SUB_BUCKETS)
+            return index;
+      magnitude = index / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+      sub = index % HIST_SUB_BUCKETS;
+      return (unsigned long long)(HIST_SUB_BUCKETS + sub) << (magnitude - HIST_SUB_BITS);
+}
+
+//Records the time since start in microseconds
+void histogramRecord(struct latencyHistogram *h, struct timespec *start)
+{
+      struct timespec now;
+      unsigned long long micros;
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      micros = (now.tv_sec - start->tv_sec) * 1000000ULL + (now.tv_nsec - start->tv_nsec) / 1000;
+      h->counts[histogramIndex(micros)]++;
+      h->total++;
+      h->sum += micros;
+      if(micros > h->max)
+            h->max = micros;
+}
+
+unsigned long long histogramPercentile(struct latencyHistogram *h, double percentile)
 {
+      unsigned long wanted = (unsigned long)(h->total * percentile / 100.0 + 0.5);
+      unsigned long seen = 0;
       int i;
-      printf("Welcome to the help page\n");
-      printf("Enter the query\n");
-      printf("The following functions are built in:\n");
 
-      for (i = 0; i < sst_num_builtins(); i++) 
+      if(wanted == 0)
+            wanted = 1;
+      for(i = 0 ; i < HIST_BUCKETS ; i++)
       {
-            printf("  %s\n", builtin_str[i]);
+            seen += h->counts[i];
+            if(seen >= wanted)
+                  return histogramValue(i);
       }
-
-      printf("Use the man command for information on other programs.\n");
-      return 1;
+      return h->max;
 }
 
-int sst_exit(char **args)
+void histogramPrint(struct latencyHistogram *h)
 {
-      printf("Bye-bye\n");
-      return 0;
+      if(h->total == 0)
+      {
+            printf("  %-6s %10d\n", h->name, 0);
+            return;
+      }
+      printf("  %-6s %10lu %10.1f %10llu %10llu %10llu %10llu %10llu\n", h->name, h->total, (double)h->sum / h->total,
+            histogramPercentile(h, 50), histogramPercentile(h, 90), histogramPercentile(h, 99),
+            histogramPercentile(h, 99.9), h->max);
 }
 
-int sst_execute(char **args)
+void histogramReset(struct latencyHistogram *h)
 {
-      int i;
+      memset(h->counts, 0, sizeof(h->counts));
+      h->total = 0;
+      h->sum = 0;
+      h->max = 0;
+}
 
-      if (args[0] == NULL) 
+int sst_shellstat(char **args)
+{
+      if (args[1] != NULL && strcmp(args[1], "reset") == 0)
       {
+            memset(&shellCounters, 0, sizeof(shellCounters));
+            memset(execCounters, 0, sizeof(struct execCounters));
+            histogramReset(&parseLatency);
+            histogramReset(&spawnLatency);
+            histogramReset(&waitLatency);
             return 1;
       }
+      printf("read bytes        %lu\n", shellCounters.readBytes);
+      printf("read lines        %lu\n", shellCounters.readLines);
+      printf("tokens            %lu\n", shellCounters.tokens);
+      printf("token reallocs    %lu\n", shellCounters.tokenReallocs);
+      printf("forks             %lu\n", shellCounters.forks);
+      printf("zygote spawns     %lu\n", shellCounters.zygoteSpawns);
+      printf("execs             %lu\n", execCounters->attempts - execCounters->failures);
+      printf("failed execs      %lu\n", execCounters->failures);
+      printf("dir entries       %lu\n", shellCounters.dirEntries);
+      printf("glob matches      %lu\n", shellCounters.globMatches);
+      printf("alias lookups     %lu\n", shellCounters.aliasLookups);
+      printf("memo hits         %lu\n", shellCounters.memoHits);
+      printf("memo misses       %lu\n", shellCounters.memoMisses);
+      printf("heredoc pipes     %lu\n", shellCounters.heredocPipes);
+      printf("heredoc memfds    %lu\n", shellCounters.heredocMemfds);
+      printf("latency (us)       count       mean        p50        p90        p99      p99.9        max\n");
+      histogramPrint(&parseLatency);
+      histogramPrint(&spawnLatency);
+      histogramPrint(&waitLatency);
+      return 1;
+}
 
-      for (i = 0; i < sst_num_builtins(); i++) 
+//fork() for every child the shell starts. stdio is flushed first so the child
+//does not write out the shell's pending output a second time.
+pid_t sst_fork(void)
+{
+      struct timespec start;
+      pid_t pid;
+
+      fflush(stdout);
+      fflush(stderr);
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      pid = fork();
+      if(pid == 0)
       {
-            if (strcmp(args[0], builtin_str[i]) == 0)
+            sigprocmask(SIG_SETMASK, &shellSignalMask, NULL); //the shell blocks SIGCHLD for its signalfd
+            sst_join_group(0);
+            if(zygoteFd >= 0) //the socket belongs to the shell
             {
-                  if(i == 0)
-                        return sst_cd(args);
-                  else if(i == 1)
-                        return sst_help(args);
-                  else if(i == 2)
-                        return sst_exit(args);
+                  close(zygoteFd);
+                  zygoteFd = -1;
             }
+            limitChild();
       }
-      return sst_launch(args);
+      else if(pid > 0)
+      {
+            sst_join_group(pid);
+            shellCounters.forks++;
+            histogramRecord(&spawnLatency, &start);
+      }
+      return pid;
 }
 
-int sst_launch(char **args)
+/*
+  Resource limits for "limit --mem <size> --cpu <cores> command". Each
+  limited command gets its own cgroup v2 group, <root>/ownsh-<pid>/job-<n>,
+  which every child joins before exec. memory.max and cpu.max cap the group
+  and memory.peak and cpu.stat are read back when it finishes. The root is
+  SST_CGROUP_ROOT or the shell's own group on the cgroup2 mount, and it is
+  only used if it has cgroup.controllers. When a controller is missing the
+  memory limit falls back to setrlimit(RLIMIT_AS) with a warning, since
+  that caps virtual rather than resident memory.
+*/
+#define CPU_PERIOD_US 100000
+
+struct jobLimit
 {
-      pid_t pid, wpid;
-      int status;
-      int i = 0;
-      int backgroundFlag = 0;
-      while(args[i+1] != NULL)
-      {
-            i++;
-      }
-      if(strcmp(args[i],"&") == 0)
+      int active;
+      long long memory; //bytes, 0 for no limit
+      double cpu; //cores, 0 for no limit
+      char *cgroup; //the job's group, NULL without a usable hierarchy
+      int procsFd; //its cgroup.procs, written by every child
+      int memoryCapped; //memory.max took the limit
+} currentLimit = {0, 0, 0, NULL, -1, 0};
+
+char *cgroupBasePath = NULL; //<root>/ownsh-<pid>, created on first use
+pid_t cgroupOwner;
+int cgroupChecked = 0;
+int cgroupJobs = 0;
+
+//Parses 512K, 100M, 2G or a plain byte count. Returns -1 if it is not a size.
+long long parseSize(char *text)
+{
+      char *end;
+      double value = strtod(text, &end);
+
+      if(end == text || value <= 0)
+            return -1;
+      if(*end == 'k' || *end == 'K')
+            value *= 1024, end++;
+      else if(*end == 'm' || *end == 'M')
+            value *= 1024 * 1024, end++;
+      else if(*end == 'g' || *end == 'G')
+            value *= 1024 * 1024 * 1024, end++;
+      if(*end == 'b' || *end == 'B')
+            end++;
+      if(*end != '\0')
+            return -1;
+      return (long long)value;
+}
+
+//Writes text to a control file of a group. Returns 0 on success.
+int cgroupWrite(char *dir, char *file, char *text)
+{
+      char path[PATH_MAX];
+      int fd, ok;
+
+      snprintf(path, sizeof(path), "%s/%s", dir, file);
+      fd = open(path, O_WRONLY | O_TRUNC | O_CLOEXEC); //a missing file means the controller is not enabled
+      if(fd < 0)
+            return -1;
+      ok = write(fd, text, strlen(text)) == (ssize_t)strlen(text);
+      close(fd);
+      return ok ? 0 : -1;
+}
+
+//Reads one control file of a group into text. Returns -1 if it is missing.
+int cgroupRead(char *dir, char *file, char *text, int size)
+{
+      char path[PATH_MAX];
+      int fd, n;
+
+      snprintf(path, sizeof(path), "%s/%s", dir, file);
+      fd = open(path, O_RDONLY | O_CLOEXEC);
+      if(fd < 0)
+            return -1;
+      n = read(fd, text, size - 1);
+      close(fd);
+      if(n < 0)
+            return -1;
+      text[n] = '\0';
+      return n;
+}
+
+//Finds the group the shell's jobs go under and creates ownsh-<pid> in it
+char *cgroupBase(void)
+{
+      char root[PATH_MAX], line[PATH_MAX + 256], self[PATH_MAX + 256];
+      FILE *fp;
+      int fd;
+
+      if(cgroupChecked)
+            return cgroupBasePath;
+      cgroupChecked = 1;
+      root[0] = '\0';
+      if(sst_getenv("SST_CGROUP_ROOT") != NULL)
       {
-            backgroundFlag = 1;
-            args[i] = NULL; //removing & from BG Process
+            snprintf(root, sizeof(root), "%s", sst_getenv("SST_CGROUP_ROOT"));
       }
-      pid = fork();
-      if (pid == 0) //Child Process
+      else if((fp = fopen("/proc/self/mountinfo", "r")) != NULL)
       {
-            if (execvp(args[0], args) == -1) 
+            //mount point is the fifth field, the type follows " - "
+            while(root[0] == '\0' && fgets(line, sizeof(line), fp) != NULL)
             {
-                  perror("sst");
+                  char mount[PATH_MAX];
+                  char *type = strstr(line, " - ");
+                  if(type != NULL && strncmp(type + 3, "cgroup2 ", 8) == 0
+                        && sscanf(line, "%*s %*s %*s %*s %4095s", mount) == 1)
+                        snprintf(root, sizeof(root), "%s", mount);
             }
-            exit(EXIT_FAILURE);
-      } 
-      else if (pid < 0) 
-      {
-            perror("sst");
-      } 
-      else 
-      {
-            if(backgroundFlag != 1)
+            fclose(fp);
+            self[0] = '\0';
+            if(root[0] != '\0' && (fp = fopen("/proc/self/cgroup", "r")) != NULL)
             {
-                  do //wait for child to finish
+                  while(fgets(line, sizeof(line), fp) != NULL)
                   {
-                        wpid = waitpid(pid, &status, WUNTRACED);
-                        /*WUNTRACED The status of any child processes specified by pid that are stopped, 
-                        and whose status has not yet been reported since they stopped, shall also be 
-                        reported to the requesting process.*/
-                   }while (!WIFEXITED(status) && !WIFSIGNALED(status));
+                        if(strncmp(line, "0::", 3) == 0)
+                        {
+                              snprintf(self, sizeof(self), "%s", line + 3);
+                              self[strcspn(self, "\n")] = '\0';
+                        }
+                  }
+                  fclose(fp);
             }
+            if(strcmp(self, "/") != 0)
+                  strncat(root, self, sizeof(root) - strlen(root) - 1);
       }
-      backgroundFlag = 0;
-      return 1;
+      if(root[0] == '\0')
+            return NULL;
+      snprintf(line, sizeof(line), "%s/cgroup.controllers", root);
+      if(access(line, F_OK) < 0) //a plain directory is not a cgroup
+            return NULL;
+      strncat(root, "/cgroup.subtree_control", sizeof(root) - strlen(root) - 1);
+      if((fd = open(root, O_WRONLY | O_CLOEXEC)) >= 0)
+      {
+            ssize_t n = write(fd, "+memory +cpu", 12); //fails unless the group is delegated
+            (void)n;
+            close(fd);
+      }
+      *strrchr(root, '/') = '\0';
+      snprintf(line, sizeof(line), "%s/ownsh-%d", root, (int)getpid());
+      if(mkdir(line, 0755) < 0 && errno != EEXIST)
+            return NULL;
+      cgroupWrite(line, "cgroup.subtree_control", "+memory +cpu");
+      cgroupBasePath = strdup(line);
+      cgroupOwner = getpid();
+      atexit(cgroupCleanup);
+      return cgroupBasePath;
 }
 
-#define SST_RL_BUFSIZE 1024
+//Removes a job's group once its processes are gone
+void cgroupRemove(char *dir)
+{
+      rmdir(dir); //control files do not count, only processes keep it busy
+}
 
-char *sst_read_line(void)
+//Removes ownsh-<pid> when the shell exits
+void cgroupCleanup(void)
 {
-      int bufsize = SST_RL_BUFSIZE;
-      int position = 0;
-      char *buffer = malloc(sizeof(char) * bufsize);
-      int c;
+      DIR *dir;
+      struct dirent *entry;
+      char path[PATH_MAX];
 
-      if (!buffer) 
+      if(cgroupBasePath == NULL || getpid() != cgroupOwner) //children exit through here too
+            return;
+      if((dir = opendir(cgroupBasePath)) != NULL) //groups of jobs that outlived the shell's interest
       {
-            fprintf(stderr, "sst: allocation error\n");
-            exit(EXIT_FAILURE);
+            while((entry = readdir(dir)) != NULL)
+            {
+                  if(strncmp(entry->d_name, "job-", 4) != 0)
+                        continue;
+                  snprintf(path, sizeof(path), "%s/%s", cgroupBasePath, entry->d_name);
+                  cgroupRemove(path);
+            }
+            closedir(dir);
       }
+      cgroupRemove(cgroupBasePath);
+}
 
-      while (1) 
-      {
-            // Read a character
-            c = getchar();
+//Reads memory.peak and cpu.stat of a group
+void cgroupReadUsage(char *dir, struct cgroupUsage *usage)
+{
+      char text[1024], *line;
 
-            // If we hit EOF, replace it with a null character and return.
-            if (c == EOF || c == '\n') 
-            {
-                  buffer[position] = '\0';
-                  return buffer;
-            } 
-            else 
+      usage->valid = 1;
+      usage->memoryPeak = -1;
+      usage->cpuUsec = -1;
+      usage->throttledUsec = 0;
+      usage->throttledCount = 0;
+      if(cgroupRead(dir, "memory.peak", text, sizeof(text)) > 0)
+            usage->memoryPeak = atoll(text);
+      if(cgroupRead(dir, "cpu.stat", text, sizeof(text)) > 0)
+      {
+            for(line = strtok(text, "\n") ; line != NULL ; line = strtok(NULL, "\n"))
             {
-                  buffer[position] = c;
+                  sscanf(line, "usage_usec %lld", &usage->cpuUsec);
+                  sscanf(line, "throttled_usec %lld", &usage->throttledUsec);
+                  sscanf(line, "nr_throttled %lld", &usage->throttledCount);
             }
-            position++;
+      }
+}
 
-            // If we have exceeded the buffer, reallocate.
-            if (position >= bufsize) 
+//Creates the group for a limited command. Limits that no controller takes
+//are applied with setrlimit in each child instead.
+void limitStart(long long memory, double cpu)
+{
+      char *base = cgroupBase();
+      char dir[PATH_MAX], text[64];
+
+      currentLimit.active = 1;
+      currentLimit.memory = memory;
+      currentLimit.cpu = cpu;
+      currentLimit.cgroup = NULL;
+      currentLimit.procsFd = -1;
+      currentLimit.memoryCapped = 0;
+      if(base != NULL)
+      {
+            snprintf(dir, sizeof(dir), "%s/job-%d", base, ++cgroupJobs);
+            if(mkdir(dir, 0755) == 0 || errno == EEXIST)
             {
-                  bufsize += SST_RL_BUFSIZE;
-                  buffer = realloc(buffer, bufsize);
-                  if (!buffer) 
-                  {
-                        fprintf(stderr, "sst: allocation error\n");
-                        exit(EXIT_FAILURE);
-                  }
+                  char procs[PATH_MAX + 16];
+                  snprintf(procs, sizeof(procs), "%s/cgroup.procs", dir);
+                  currentLimit.procsFd = open(procs, O_WRONLY | O_CLOEXEC);
+                  if(currentLimit.procsFd >= 0)
+                        currentLimit.cgroup = strdup(dir);
+                  else
+                        rmdir(dir);
             }
       }
+      if(currentLimit.cgroup != NULL && memory > 0)
+      {
+            snprintf(text, sizeof(text), "%lld\n", memory);
+            currentLimit.memoryCapped = cgroupWrite(currentLimit.cgroup, "memory.max", text) == 0;
+      }
+      if(memory > 0 && !currentLimit.memoryCapped) //e.g. subtree_control was not writable
+            fprintf(stderr, "sst: limit: no memory controller, --mem caps virtual memory with RLIMIT_AS instead\n");
+      if(cpu > 0)
+      {
+            snprintf(text, sizeof(text), "%lld %d\n", (long long)(cpu * CPU_PERIOD_US), CPU_PERIOD_US);
+            if(currentLimit.cgroup == NULL || cgroupWrite(currentLimit.cgroup, "cpu.max", text) < 0)
+                  fprintf(stderr, "sst: limit: no cpu controller, --cpu is not enforced\n");
+      }
 }
 
-#define SST_TOK_BUFSIZE 64
+//Runs in every child of a limited command, before exec
+void limitChild(void)
+{
+      char text[32];
+      struct rlimit rl;
 
+      if(!currentLimit.active)
+            return;
+      if(currentLimit.procsFd >= 0)
+      {
+            snprintf(text, sizeof(text), "%d\n", (int)getpid());
+            if(write(currentLimit.procsFd, text, strlen(text)) < 0)
+                  perror("sst: cgroup.procs");
+      }
+      if(currentLimit.memory > 0 && !currentLimit.memoryCapped)
+      {
+            rl.rlim_cur = rl.rlim_max = currentLimit.memory;
+            setrlimit(RLIMIT_AS, &rl);
+      }
+}
 
-char **sst_split_line(char *line, char *s)
+//Records the group's usage for the timing output and the trace, then
+//removes it unless a background job still owns it
+void limitFinish(void)
 {
-      int bufsize = SST_TOK_BUFSIZE, position = 0;
-      char **tokens = malloc(bufsize * sizeof(char*));
-      char *token;
+      if(currentLimit.cgroup != NULL)
+      {
+            cgroupReadUsage(currentLimit.cgroup, &currentStats.cgroup);
+            cgroupRemove(currentLimit.cgroup);
+            free(currentLimit.cgroup);
+      }
+      if(currentLimit.procsFd >= 0)
+            close(currentLimit.procsFd);
+      currentLimit.active = 0;
+      currentLimit.cgroup = NULL;
+      currentLimit.procsFd = -1;
+}
 
-      if (!tokens)
+/*
+  Zygote. With SST_ZYGOTE=1 the shell forks a helper at startup, while its
+  image is still small, and foreground commands are forked from the helper
+  rather than from the shell, so a long session does not make every fork
+  copy a large page table. Requests go over a SOCK_SEQPACKET socketpair as
+  one message: a header, then argv, the cwd and the environment as NUL
+  terminated strings, with the child's stdin, stdout and stderr attached as
+  SCM_RIGHTS. The helper answers with the pid, and later with the exit
+  status and rusage, since the shell cannot wait for a process that is not
+  its own child.
+*/
+#define ZYGOTE_MAX_REQUEST 262144
+
+struct zygoteRequest
+{
+      pid_t pgid; //-1 stays in the shell's group, 0 starts a new one
+      int argc;
+      int envc;
+};
+
+struct zygoteReply
+{
+      char type; //'P' started, 'X' exited
+      pid_t pid;
+      int status; //wait status for 'X', errno for a failed 'P'
+      struct rusage usage;
+};
+
+struct zygoteExit
+{
+      pid_t pid;
+      int status;
+      struct rusage usage;
+      struct zygoteExit *next;
+};
+
+pid_t zygotePid = 0;
+struct zygoteExit *zygoteExits = NULL; //exits read while waiting for something else
+
+//Starts one child for a request. Runs in the zygote.
+void zygoteStartChild(int fd, int sigFd, sigset_t *childMask, char *data, int *fds)
+{
+      struct zygoteRequest header;
+      struct zygoteReply reply;
+      char **argv, **envp, *cwd, *p;
+      int i;
+
+      memcpy(&header, data, sizeof(header));
+      argv = malloc(sizeof(char*) * (header.argc + 1));
+      envp = malloc(sizeof(char*) * (header.envc + 1));
+      if(!argv || !envp)
       {
             fprintf(stderr, "sst: allocation error\n");
             exit(EXIT_FAILURE);
       }
-      //tokenizing the string
-      token = strtok(line, s);
+      p = data + sizeof(header);
+      for(i = 0 ; i < header.argc ; i++, p += strlen(p) + 1)
+            argv[i] = p;
+      argv[i] = NULL;
+      cwd = p;
+      p += strlen(p) + 1;
+      for(i = 0 ; i < header.envc ; i++, p += strlen(p) + 1)
+            envp[i] = p;
+      envp[i] = NULL;
 
-      while (token != NULL) 
+      memset(&reply, 0, sizeof(reply));
+      reply.type = 'P';
+      reply.pid = fork();
+      if(reply.pid == 0)
       {
-            tokens[position] = token;
-            position++;
-            if(strcmp(token,"|") == 0) //Assuming there are spaces between pipes
-            {
-                  pipeInInputFlag = 1;
-            }
-            if(strcmp(token,"<") == 0)
+            sigprocmask(SIG_SETMASK, childMask, NULL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            if(header.pgid >= 0)
+                  setpgid(0, header.pgid);
+            for(i = 0 ; i < 3 ; i++)
             {
-                  redirectionLessThan = 1;
+                  dup2(fds[i], i);
             }
-            if(strcmp(token,">") == 0)
+            for(i = 0 ; i < 3 ; i++)
             {
-                  redirectionGreaterThan = 1;
+                  if(fds[i] > 2)
+                        close(fds[i]);
             }
-            if (position >= bufsize) 
+            close(fd);
+            close(sigFd);
+            if(chdir(cwd) < 0 || sst_exec(NULL, argv, envp) < 0)
             {
-                  bufsize += SST_TOK_BUFSIZE;
-                  tokens = realloc(tokens, bufsize * sizeof(char*));
-                  if (!tokens)
-                  {
-                        fprintf(stderr, "sst: allocation error\n");
-                        exit(EXIT_FAILURE);
-                  }
+                  perror("sst");
             }
-            //get next token
-            token = strtok(NULL, s);
+            _exit(127);
       }
-      tokens[position] = NULL;
-      return tokens;
+      if(reply.pid < 0)
+            reply.status = errno;
+      else if(header.pgid >= 0)
+            setpgid(reply.pid, header.pgid ? header.pgid : reply.pid); //also done in the child, whichever runs first
+      send(fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+      free(argv);
+      free(envp);
 }
 
-int checkForCommands(char *line)
+//Main loop of the zygote. Exits when the shell closes its end.
+void zygoteServe(int fd, sigset_t *childMask)
 {
-      int status = 1;
-      char **args;
-      char *copyLine = malloc(sizeof(char)*strlen(line));
-      strcpy(copyLine,line);
+      char *data = malloc(ZYGOTE_MAX_REQUEST);
+      char control[CMSG_SPACE(sizeof(int) * 3)];
+      sigset_t mask;
+      struct pollfd fds[2];
+      struct zygoteReply reply;
+      int sigFd, status;
 
-      if(strcmp(line,"history") == 0)
+      if(!data)
       {
-            historyPrint();
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      signal(SIGINT, SIG_IGN); //^C and ^Z are meant for the command, not for the helper
+      signal(SIGQUIT, SIG_IGN);
+      signal(SIGTSTP, SIG_IGN);
+      sigemptyset(&mask);
+      sigaddset(&mask, SIGCHLD);
+      sigprocmask(SIG_BLOCK, &mask, NULL);
+      sigFd = signalfd(-1, &mask, SFD_CLOEXEC);
+      fds[0].fd = fd;
+      fds[0].events = POLLIN;
+      fds[1].fd = sigFd;
+      fds[1].events = POLLIN;
+      while(1)
+      {
+            if(poll(fds, 2, -1) < 0)
+            {
+                  if(errno == EINTR)
+                        continue;
+                  _exit(1);
+            }
+            if(fds[1].revents & POLLIN)
+            {
+                  struct signalfd_siginfo info;
+                  if(read(sigFd, &info, sizeof(info)) < 0 && errno != EAGAIN)
+                        _exit(1);
+                  memset(&reply, 0, sizeof(reply));
+                  reply.type = 'X';
+                  while((reply.pid = wait4(-1, &status, WNOHANG, &reply.usage)) > 0)
+                  {
+                        reply.status = status;
+                        send(fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+                  }
+            }
+            if(fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                  struct iovec iov = {data, ZYGOTE_MAX_REQUEST};
+                  struct msghdr msg;
+                  struct cmsghdr *cmsg;
+                  int passed[3] = {-1, -1, -1};
+                  ssize_t n;
+
+                  memset(&msg, 0, sizeof(msg));
+                  msg.msg_iov = &iov;
+                  msg.msg_iovlen = 1;
+                  msg.msg_control = control;
+                  msg.msg_controllen = sizeof(control);
+                  n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+                  if(n < 0 && errno == EINTR)
+                        continue;
+                  if(n <= 0)
+                        _exit(0);
+                  cmsg = CMSG_FIRSTHDR(&msg);
+                  if(cmsg != NULL && cmsg->cmsg_type == SCM_RIGHTS)
+                        memcpy(passed, CMSG_DATA(cmsg), sizeof(passed));
+                  if(n >= (ssize_t)sizeof(struct zygoteRequest) && passed[2] >= 0)
+                        zygoteStartChild(fd, sigFd, childMask, data, passed);
+                  for(int i = 0 ; i < 3 ; i++)
+                  {
+                        if(passed[i] >= 0)
+                              close(passed[i]);
+                  }
+            }
+      }
+}
+
+void zygoteStart(void)
+{
+      int sv[2];
+      sigset_t mask;
+
+      if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+      {
+            perror("sst");
+            return;
+      }
+      sigprocmask(SIG_SETMASK, NULL, &mask);
+      zygotePid = fork();
+      if(zygotePid == 0)
+      {
+            close(sv[0]);
+            zygoteServe(sv[1], &mask);
+            _exit(0);
+      }
+      close(sv[1]);
+      if(zygotePid < 0)
+      {
+            perror("sst");
+            close(sv[0]);
+            return;
+      }
+      zygoteFd = sv[0];
+}
+
+//Stops using the zygote, e.g. after it died. Commands are forked by the shell again.
+void zygoteStop(void)
+{
+      if(zygoteFd < 0)
+            return;
+      close(zygoteFd);
+      zygoteFd = -1;
+      fprintf(stderr, "sst: zygote is gone, forking from the shell\n");
+}
+
+//Reads one reply. Returns -1 if the zygote is gone.
+int zygoteRead(struct zygoteReply *reply)
+{
+      ssize_t n;
+
+      while((n = recv(zygoteFd, reply, sizeof(*reply), 0)) < 0 && errno == EINTR)
+            ;
+      if(n != sizeof(*reply))
+      {
+            zygoteStop();
+            return -1;
+      }
+      if(reply->type == 'X') //keep it for zygoteWait
+      {
+            struct zygoteExit *e = malloc(sizeof(struct zygoteExit));
+            if(!e)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+            e->pid = reply->pid;
+            e->status = reply->status;
+            e->usage = reply->usage;
+            e->next = zygoteExits;
+            zygoteExits = e;
+      }
+      return 0;
+}
+
+//Starts args through the zygote with the given stdin/stdout (-1 for the
+//shell's own). Returns the pid, or -1 so the caller forks by itself.
+pid_t zygoteSpawn(char **args, int inFd, int outFd)
+{
+      struct sst_buffer request;
+      struct zygoteRequest header;
+      struct zygoteReply reply;
+      struct timespec start;
+      char control[CMSG_SPACE(sizeof(int) * 3)];
+      int fds[3];
+      char *cwd;
+      int i;
+
+      if(zygoteFd < 0 || args[0] == NULL || currentLimit.active) //the zygote's children cannot join the group
+            return -1;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      header.pgid = currentStats.hasDeadline ? currentStats.pgid : -1;
+      header.argc = 0;
+      header.envc = 0;
+      sst_buffer_init(&request);
+      sst_buffer_append(&request, (char *)&header, sizeof(header));
+      for( ; args[header.argc] != NULL ; header.argc++)
+            sst_buffer_append(&request, args[header.argc], strlen(args[header.argc]) + 1);
+      cwd = getcwd(NULL, 0);
+      sst_buffer_append(&request, cwd != NULL ? cwd : ".", strlen(cwd != NULL ? cwd : ".") + 1);
+      free(cwd);
+      char **envp = sst_environ();
+      for( ; envp[header.envc] != NULL ; header.envc++)
+            sst_buffer_append(&request, envp[header.envc], strlen(envp[header.envc]) + 1);
+      memcpy(request.data, &header, sizeof(header));
+      if(request.length > ZYGOTE_MAX_REQUEST)
+      {
+            sst_buffer_free(&request);
+            return -1;
+      }
+
+      struct iovec iov = {request.data, request.length};
+      struct msghdr msg;
+      struct cmsghdr *cmsg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+      fds[0] = inFd >= 0 ? inFd : STDIN_FILENO;
+      fds[1] = outFd >= 0 ? outFd : STDOUT_FILENO;
+      fds[2] = STDERR_FILENO;
+      memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+      fflush(stdout);
+      fflush(stderr);
+      while((i = sendmsg(zygoteFd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+            ;
+      sst_buffer_free(&request);
+      if(i < 0)
+      {
+            zygoteStop();
+            return -1;
+      }
+      do
+      {
+            if(zygoteRead(&reply) < 0)
+                  return -1;
+      }while(reply.type != 'P');
+      if(reply.pid < 0)
+      {
+            errno = reply.status;
+            return -1;
+      }
+      sst_join_group(reply.pid); //the zygote already moved it, this only takes the terminal
+      shellCounters.zygoteSpawns++;
+      histogramRecord(&spawnLatency, &start);
+      return reply.pid;
+}
+
+//Waits for a process started by the zygote. Returns -1 if it is unknown.
+int zygoteWait(pid_t pid, int *status, struct rusage *usage)
+{
+      struct zygoteReply reply;
+
+      while(1)
+      {
+            struct zygoteExit **link = &zygoteExits;
+            while(*link != NULL && (*link)->pid != pid)
+                  link = &(*link)->next;
+            if(*link != NULL)
+            {
+                  struct zygoteExit *e = *link;
+                  *status = e->status;
+                  *usage = e->usage;
+                  *link = e->next;
+                  free(e);
+                  return 0;
+            }
+            if(zygoteFd < 0 || zygoteRead(&reply) < 0)
+                  return -1;
+      }
+}
+
+/*
+  Command deadlines. A command run with "timeout <duration>", or any command
+  when SST_TIMEOUT is set and the shell is not interactive, runs in its own
+  process group. sst_wait polls a pidfd for each stage until the deadline,
+  then sends SIGTERM to the group and SIGKILL after a grace period. The
+  command's exit status becomes 124.
+*/
+#define TIMEOUT_GRACE_MS 2000
+#define TIMEOUT_EXIT_STATUS 124
+
+double defaultTimeout = 0; //seconds, from SST_TIMEOUT, for non-interactive runs
+
+//Parses 10, 1.5s, 250ms, 2m or 1h into seconds. Returns -1 if malformed.
+double parseDuration(char *text)
+{
+      char *end;
+      double value = strtod(text, &end);
+
+      if(end == text || value <= 0)
+            return -1;
+      if(*end == '\0' || strcmp(end, "s") == 0)
+            return value;
+      if(strcmp(end, "ms") == 0)
+            return value / 1000;
+      if(strcmp(end, "m") == 0)
+            return value * 60;
+      if(strcmp(end, "h") == 0)
+            return value * 3600;
+      return -1;
+}
+
+void sst_set_deadline(double seconds)
+{
+      long long nanos = (long long)(seconds * 1000000000.0);
+
+      clock_gettime(CLOCK_MONOTONIC, &currentStats.deadline);
+      currentStats.deadline.tv_sec += nanos / 1000000000LL;
+      currentStats.deadline.tv_nsec += nanos % 1000000000LL;
+      if(currentStats.deadline.tv_nsec >= 1000000000L)
+      {
+            currentStats.deadline.tv_sec++;
+            currentStats.deadline.tv_nsec -= 1000000000L;
+      }
+      currentStats.hasDeadline = 1;
+      currentStats.timeoutSeconds = seconds;
+}
+
+//Puts a child of a command with a deadline into the command's process group.
+//Called in both parent and child so neither can run ahead of the other.
+void sst_join_group(pid_t pid)
+{
+      if(!currentStats.hasDeadline)
+            return;
+      if(currentStats.pgid == 0)
+      {
+            currentStats.pgid = pid;
+            if(pid != 0 && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp())
+            {
+                  setpgid(pid, pid);
+                  tcsetpgrp(STDIN_FILENO, pid); //the job may still read the terminal
+                  currentStats.ownsTerminal = 1;
+                  return;
+            }
+      }
+      setpgid(pid, currentStats.pgid);
+}
+
+//Gives the terminal back to the shell once a timed command has finished
+void sst_restore_terminal(void)
+{
+      sigset_t block, old;
+
+      if(!currentStats.ownsTerminal)
+            return;
+      sigemptyset(&block);
+      sigaddset(&block, SIGTTOU); //the shell is a background group until this returns
+      sigprocmask(SIG_BLOCK, &block, &old);
+      tcsetpgrp(STDIN_FILENO, getpgrp());
+      sigprocmask(SIG_SETMASK, &old, NULL);
+      currentStats.ownsTerminal = 0;
+}
+
+//Milliseconds until the deadline, never negative
+int sst_deadline_remaining(void)
+{
+      struct timespec now;
+      double remaining;
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      remaining = sst_elapsed_ms(&now, &currentStats.deadline);
+      return remaining > 0 ? (int)(remaining + 0.999) : 0;
+}
+
+//Blocks until pid exits or the deadline passes, tearing the group down then
+void sst_enforce_deadline(pid_t pid)
+{
+      int pidfd;
+      struct pollfd pfd;
+
+      if(!currentStats.hasDeadline || currentStats.timedOut)
+            return;
+      pidfd = syscall(SYS_pidfd_open, pid, 0);
+      if(pidfd < 0)
+      {
+            perror("sst: pidfd_open");
+            return;
+      }
+      pfd.fd = pidfd;
+      pfd.events = POLLIN;
+      while(poll(&pfd, 1, sst_deadline_remaining()) < 0 && errno == EINTR)
+            ;
+      if(!(pfd.revents & POLLIN) && sst_deadline_remaining() == 0)
+      {
+            currentStats.timedOut = 1;
+            kill(-currentStats.pgid, SIGTERM);
+            kill(-currentStats.pgid, SIGCONT); //a stopped job cannot handle SIGTERM
+            pfd.revents = 0;
+            while(poll(&pfd, 1, TIMEOUT_GRACE_MS) < 0 && errno == EINTR)
+                  ;
+            if(!(pfd.revents & POLLIN))
+                  kill(-currentStats.pgid, SIGKILL);
+      }
+      close(pidfd);
+}
+
+//getting the size of the builtin funtion array
+int sst_num_builtins() 
+{
+      return sizeof(builtin_str) / sizeof(char *);
+}
+
+int sst_cd(char **args)
+{
+      if (args[1] == NULL) 
+      {
+            fprintf(stderr, "sst: expected argument to \"cd\"\n");
+      } 
+      else 
+      {
+            if (chdir(args[1]) != 0) 
+            {
+                  perror("sst");
+            }
+      }
+      return 1;
+}
+
+int sst_help(char **args)
+{
+      int i;
+      printf("Welcome to the help page\n");
+      printf("Enter the query\n");
+      printf("The following functions are built in:\n");
+
+      for (i = 0; i < sst_num_builtins(); i++) 
+      {
+            printf("  %s\n", builtin_str[i]);
+      }
+
+      printf("Use the man command for information on other programs.\n");
+      return 1;
+}
+
+int sst_exit(char **args)
+{
+      printf("Bye-bye\n");
+      return 0;
+}
+
+int sst_echo(char **args)
+{
+      int i = 1;
+      int newline = 1;
+
+      if (args[1] != NULL && strcmp(args[1], "-n") == 0)
+      {
+            newline = 0;
+            i++;
+      }
+      for ( ; args[i] != NULL ; i++)
+      {
+            fputs(args[i], stdout);
+            if (args[i+1] != NULL)
+                  putchar(' ');
+      }
+      if (newline)
+            putchar('\n');
+      lastExitStatus = 0;
+      return 1;
+}
+
+int sst_timing(char **args)
+{
+      if (args[1] == NULL)
+      {
+            printf("timing is %s\n", shellOptions.timing ? "on" : "off");
+      }
+      else if (strcmp(args[1], "on") == 0)
+      {
+            shellOptions.timing = 1;
+      }
+      else if (strcmp(args[1], "off") == 0)
+      {
+            shellOptions.timing = 0;
+      }
+      else
+      {
+            fprintf(stderr, "sst: usage: timing [on|off]\n");
+      }
+      return 1;
+}
+
+int sst_execute(char **args)
+{
+      int i;
+
+      if (args[0] == NULL) 
+      {
+            return 1;
+      }
+      unprotectArgs(args);
+
+      for (i = 0; i < sst_num_builtins(); i++) 
+      {
+            if (strcmp(args[0], builtin_str[i]) == 0)
+            {
+                  if(i == 0)
+                        return sst_cd(args);
+                  else if(i == 1)
+                        return sst_help(args);
+                  else if(i == 2)
+                        return sst_exit(args);
+                  else if(i == 3)
+                        return sst_timing(args);
+                  else if(i == 4)
+                        return sst_trace(args);
+                  else if(i == 5)
+                        return sst_shellstat(args);
+                  else if(i == 6)
+                        return sst_jobs(args);
+                  else if(i == 7)
+                        return sst_echo(args);
+                  else if(i == 8)
+                        return sst_hash(args);
+                  else if(i == 9)
+                        return sst_pipesize(args);
+                  else if(i == 10)
+                        return sst_pipestat(args);
+                  else if(i == 11)
+                        return sst_export(args);
+                  else if(i == 12)
+                        return sst_unset(args);
+            }
+      }
+      return sst_launch(args);
+}
+
+int sst_launch(char **args)
+{
+      pid_t pid;
+      char *path;
+      char **envp;
+      int i = 0;
+      int backgroundFlag = 0;
+      while(args[i+1] != NULL)
+      {
+            i++;
+      }
+      if(strcmp(args[i],"&") == 0)
+      {
+            backgroundFlag = 1;
+            args[i] = NULL; //removing & from BG Process
+      }
+      path = commandLookup(args[0]);
+      envp = sst_environ();
+      pid = -1;
+      if(backgroundFlag != 1) //background jobs are reaped through the shell's SIGCHLD
+            pid = zygoteSpawn(args, -1, -1);
+      if(pid < 0)
+            pid = sst_fork();
+      if (pid == 0) //Child Process
+      {
+            if (sst_exec(path, args, envp) == -1) 
+            {
+                  perror("sst");
+            }
+            exit(127); //tells the shell the exec failed
+      } 
+      else if (pid < 0) 
+      {
+            perror("sst");
+      } 
+      else 
+      {
+            if(backgroundFlag != 1)
+            {
+                  char *command = sst_join_args(args);
+                  sst_wait(pid, command);
+                  free(command);
+            }
+            else
+            {
+                  jobAdd(pid, args);
+            }
+      }
+      backgroundFlag = 0;
+      return 1;
+}
+
+//Waits for a foreground child, records its exit status in lastExitStatus
+//and its resource usage as a stage of the current command
+int sst_wait(pid_t pid, char *command)
+{
+      pid_t wpid;
+      int status = 0;
+      struct rusage usage;
+      struct timespec start;
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      sst_enforce_deadline(pid);
+      while(1) //wait for child to finish
+      {
+            wpid = wait4(pid, &status, WUNTRACED, &usage);
+            /*WUNTRACED The status of any child processes specified by pid that are stopped,
+            and whose status has not yet been reported since they stopped, shall also be
+            reported to the requesting process.*/
+            if(wpid < 0)
+            {
+                  if(errno == EINTR)
+                        continue;
+                  if(errno == ECHILD && zygoteWait(pid, &status, &usage) == 0) //started by the zygote
+                        break;
+                  return lastExitStatus;
+            }
+            if(WIFEXITED(status) || WIFSIGNALED(status))
+                  break;
+      }
+
+      histogramRecord(&waitLatency, &start);
+      if(WIFEXITED(status))
+            lastExitStatus = WEXITSTATUS(status);
+      else
+            lastExitStatus = 128 + WTERMSIG(status);
+
+      if(currentStats.stageCount >= currentStats.stageCapacity)
+      {
+            currentStats.stageCapacity = currentStats.stageCapacity ? currentStats.stageCapacity * 2 : 8;
+            currentStats.stages = realloc(currentStats.stages, sizeof(struct stageStats) * currentStats.stageCapacity);
+            if(!currentStats.stages)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+      }
+      struct stageStats *stage = &currentStats.stages[currentStats.stageCount++];
+      if(command == NULL)
+            command = "";
+      while(*command == ' ')
+            command++;
+      stage->pid = pid;
+      stage->command = strdup(command);
+      int length = strlen(stage->command);
+      while(length > 0 && stage->command[length-1] == ' ')
+            stage->command[--length] = '\0';
+      stage->status = lastExitStatus;
+      stage->usage = usage;
+      return lastExitStatus;
+}
+
+double sst_elapsed_ms(struct timespec *start, struct timespec *end)
+{
+      return (end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+double sst_timeval_ms(struct timeval *tv)
+{
+      return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+//Joins an argument vector back into one line, used to label stages
+char *sst_join_args(char **args)
+{
+      struct sst_buffer buf;
+      int i;
+
+      sst_buffer_init(&buf);
+      for(i = 0 ; args[i] != NULL ; i++)
+      {
+            if(i > 0)
+                  sst_buffer_putc(&buf, ' ');
+            sst_buffer_append(&buf, args[i], strlen(args[i]));
+      }
+      return buf.data;
+}
+
+void sst_stats_begin(void)
+{
+      currentStats.stages = NULL;
+      currentStats.stageCount = 0;
+      currentStats.stageCapacity = 0;
+      currentStats.redirectedBytes = 0;
+      currentStats.hasDeadline = 0;
+      currentStats.pgid = 0;
+      currentStats.ownsTerminal = 0;
+      currentStats.timedOut = 0;
+      currentStats.cgroup.valid = 0;
+      clock_gettime(CLOCK_MONOTONIC, &currentStats.start);
+      currentStats.end = currentStats.start;
+}
+
+void sst_stats_end(void)
+{
+      int i;
+      for(i = 0 ; i < currentStats.stageCount ; i++)
+      {
+            free(currentStats.stages[i].command);
+      }
+      free(currentStats.stages);
+      currentStats.stages = NULL;
+      currentStats.stageCount = 0;
+      currentStats.stageCapacity = 0;
+}
+
+//Prints what a limited command's cgroup accounted
+void cgroupPrint(struct cgroupUsage *usage, FILE *out)
+{
+      fprintf(out, "cgroup");
+      if(usage->memoryPeak >= 0)
+            fprintf(out, " memory.peak %lld KB", usage->memoryPeak / 1024);
+      if(usage->cpuUsec >= 0)
+            fprintf(out, " cpu %.2f ms throttled %.2f ms (%lld times)", usage->cpuUsec / 1000.0, usage->throttledUsec / 1000.0, usage->throttledCount);
+      if(usage->memoryPeak < 0 && usage->cpuUsec < 0)
+            fprintf(out, " has no accounting files");
+      fprintf(out, "\n");
+}
+
+//Prints the usage of every stage of the last command and the pipeline total
+void sst_stats_print(void)
+{
+      int i;
+      double user = 0, sys = 0;
+      long maxrss = 0, nvcsw = 0, nivcsw = 0, minflt = 0, majflt = 0;
+
+      fprintf(stderr, "%-5s %-7s %-6s %9s %9s %10s %6s %6s %8s %6s  %s\n",
+            "stage", "pid", "status", "user(ms)", "sys(ms)", "maxrss(KB)", "vcsw", "ivcsw", "minflt", "majflt", "command");
+      for(i = 0 ; i < currentStats.stageCount ; i++)
+      {
+            struct stageStats *st = &currentStats.stages[i];
+            fprintf(stderr, "%-5d %-7d %-6d %9.2f %9.2f %10ld %6ld %6ld %8ld %6ld  %s\n",
+                  i + 1, (int)st->pid, st->status, sst_timeval_ms(&st->usage.ru_utime), sst_timeval_ms(&st->usage.ru_stime),
+                  st->usage.ru_maxrss, st->usage.ru_nvcsw, st->usage.ru_nivcsw, st->usage.ru_minflt, st->usage.ru_majflt, st->command);
+            user += sst_timeval_ms(&st->usage.ru_utime);
+            sys += sst_timeval_ms(&st->usage.ru_stime);
+            if(st->usage.ru_maxrss > maxrss)
+                  maxrss = st->usage.ru_maxrss;
+            nvcsw += st->usage.ru_nvcsw;
+            nivcsw += st->usage.ru_nivcsw;
+            minflt += st->usage.ru_minflt;
+            majflt += st->usage.ru_majflt;
+      }
+      fprintf(stderr, "%-5s %-7s %-6d %9.2f %9.2f %10ld %6ld %6ld %8ld %6ld\n",
+            "total", "", lastExitStatus, user, sys, maxrss, nvcsw, nivcsw, minflt, majflt);
+      fprintf(stderr, "wall %.2f ms\n", sst_elapsed_ms(&currentStats.start, &currentStats.end));
+      if(currentStats.cgroup.valid)
+            cgroupPrint(&currentStats.cgroup, stderr);
+      if(currentStats.timedOut)
+            fprintf(stderr, "timed out after %.3g s\n", currentStats.timeoutSeconds);
+}
+
+//Adds the bytes a finished command read from or wrote to a redirected file.
+//The child shares the file offset with the shell, so the offset is the count.
+void sst_count_redirected(int fd)
+{
+      off_t offset = lseek(fd, 0, SEEK_CUR);
+      if(offset > 0)
+            currentStats.redirectedBytes += offset;
+}
+
+/*
+  Execution trace. Each command becomes one JSON line that the shell appends
+  to a pending batch in memory. The event loop's timer writes the batch to
+  the trace file with one write while the shell is idle, and every place
+  that runs a series of commands (the loop, a script, the editor's batch)
+  writes it between two commands once it is 200 ms old or 64 KB big, so a
+  crash loses at most that much. A served request writes it when it ends.
+  The file is rotated to <path>.1 when it gets too big. Running a command
+  never writes to the trace file.
+*/
+#define TRACE_FLUSH_INTERVAL_MS 200
+#define TRACE_FLUSH_BYTES (64 * 1024) //written between commands once this big
+#define TRACE_MAX_PENDING (1024 * 1024) //records past this are dropped
+#define TRACE_DEFAULT_MAX_BYTES (16L * 1024 * 1024)
+
+struct traceSink
+{
+      char *path;
+      int fd;
+      off_t size;
+      off_t maxBytes;
+      pid_t owner; //forked children must not add to a batch nobody writes
+      unsigned long dropped;
+      struct sst_buffer batch; //records not written yet
+      struct timespec flushed; //when the batch was last written
+} traceSink = {.path = NULL, .fd = -1};
+
+int traceOpenFile(void)
+{
+      struct stat statbuf;
+      traceSink.fd = open(traceSink.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+      if(traceSink.fd < 0)
+            return -1;
+      traceSink.size = fstat(traceSink.fd, &statbuf) == 0 ? statbuf.st_size : 0;
+      return 0;
+}
+
+void traceRotate(void)
+{
+      struct sst_buffer old;
+
+      sst_buffer_init(&old);
+      sst_buffer_append(&old, traceSink.path, strlen(traceSink.path));
+      sst_buffer_append(&old, ".1", 2);
+      close(traceSink.fd);
+      rename(traceSink.path, old.data);
+      sst_buffer_free(&old);
+      if(traceOpenFile() < 0)
+            perror("sst: trace");
+}
+
+//Writes the pending batch to the trace file
+void traceFlush(void)
+{
+      size_t length = traceSink.batch.length;
+
+      if(traceSink.path == NULL || traceSink.owner != getpid() || length == 0)
+            return;
+      if(traceSink.fd >= 0 && traceSink.size > 0 && traceSink.size + (off_t)length > traceSink.maxBytes)
+            traceRotate();
+      if(traceSink.fd >= 0 && sst_buffer_flush(&traceSink.batch, traceSink.fd) == 0)
+            traceSink.size += length;
+      traceSink.batch.length = 0;
+      clock_gettime(CLOCK_MONOTONIC, &traceSink.flushed);
+}
+
+//Writes the batch between two commands if it is big or old enough
+void traceFlushDue(void)
+{
+      struct timespec now;
+
+      if(traceSink.path == NULL || traceSink.batch.length == 0)
+            return;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if(traceSink.batch.length >= TRACE_FLUSH_BYTES || sst_elapsed_ms(&traceSink.flushed, &now) >= TRACE_FLUSH_INTERVAL_MS)
+            traceFlush();
+}
+
+int traceStart(char *path, off_t maxBytes)
+{
+      traceSink.path = strdup(path);
+      traceSink.maxBytes = maxBytes;
+      traceSink.owner = getpid();
+      traceSink.dropped = 0;
+      if(traceOpenFile() < 0)
+      {
+            perror("sst: trace");
+            free(traceSink.path);
+            traceSink.path = NULL;
+            return -1;
+      }
+      sst_buffer_init(&traceSink.batch);
+      clock_gettime(CLOCK_MONOTONIC, &traceSink.flushed);
+      return 0;
+}
+
+void traceStop(void)
+{
+      if(traceSink.path == NULL || traceSink.owner != getpid())
+            return;
+      traceFlush(); //whatever was pending before trace off
+      sst_buffer_free(&traceSink.batch);
+      close(traceSink.fd);
+      traceSink.fd = -1;
+      free(traceSink.path);
+      traceSink.path = NULL;
+}
+
+//Adds one record to the batch, or drops it when the loop has not written
+//the batch for too long
+void tracePush(char *record)
+{
+      size_t length = strlen(record);
+
+      if(traceSink.batch.length + length > TRACE_MAX_PENDING)
+            traceSink.dropped++;
+      else
+            sst_buffer_append(&traceSink.batch, record, length);
+      free(record);
+}
+
+void sst_buffer_append_json(struct sst_buffer *b, const char *s)
+{
+      char escape[8];
+
+      sst_buffer_putc(b, '"');
+      for( ; *s != '\0' ; s++)
+      {
+            unsigned char c = *s;
+            if(c == '"' || c == '\\')
+            {
+                  sst_buffer_putc(b, '\\');
+                  sst_buffer_putc(b, c);
+            }
+            else if(c < 0x20)
+            {
+                  snprintf(escape, sizeof(escape), "\\u%04x", c);
+                  sst_buffer_append(b, escape, strlen(escape));
+            }
+            else
+            {
+                  sst_buffer_putc(b, c);
+            }
+      }
+      sst_buffer_putc(b, '"');
+}
+
+//Formats the command that just finished as one JSON line and queues it
+void traceCommand(char *line)
+{
+      struct sst_buffer record;
+      struct timespec now;
+      struct tm utc;
+      char field[256];
+      double user = 0, sys = 0;
+      int i;
+
+      if(traceSink.path == NULL || traceSink.owner != getpid())
+            return;
+      clock_gettime(CLOCK_REALTIME, &now);
+      gmtime_r(&now.tv_sec, &utc);
+      for(i = 0 ; i < currentStats.stageCount ; i++)
+      {
+            user += sst_timeval_ms(&currentStats.stages[i].usage.ru_utime);
+            sys += sst_timeval_ms(&currentStats.stages[i].usage.ru_stime);
+      }
+
+      sst_buffer_init(&record);
+      strftime(field, sizeof(field), "{\"ts\":\"%Y-%m-%dT%H:%M:%S", &utc);
+      sst_buffer_append(&record, field, strlen(field));
+      snprintf(field, sizeof(field), ".%03ldZ\",\"cmd\":", now.tv_nsec / 1000000);
+      sst_buffer_append(&record, field, strlen(field));
+      sst_buffer_append_json(&record, line);
+      snprintf(field, sizeof(field), ",\"status\":%d,\"timed_out\":%s,\"wall_ms\":%.3f,\"user_ms\":%.3f,\"sys_ms\":%.3f,\"bytes_redirected\":%lld",
+            lastExitStatus, currentStats.timedOut ? "true" : "false", sst_elapsed_ms(&currentStats.start, &currentStats.end), user, sys, currentStats.redirectedBytes);
+      sst_buffer_append(&record, field, strlen(field));
+      if(currentStats.cgroup.valid)
+      {
+            struct cgroupUsage *usage = &currentStats.cgroup;
+            snprintf(field, sizeof(field), ",\"cgroup\":{\"memory_peak_kb\":%lld,\"cpu_ms\":%.3f,\"throttled_ms\":%.3f,\"nr_throttled\":%lld}",
+                  usage->memoryPeak >= 0 ? usage->memoryPeak / 1024 : -1, usage->cpuUsec >= 0 ? usage->cpuUsec / 1000.0 : -1, usage->throttledUsec / 1000.0, usage->throttledCount);
+            sst_buffer_append(&record, field, strlen(field));
+      }
+      sst_buffer_append(&record, ",\"stages\":[", 11);
+      for(i = 0 ; i < currentStats.stageCount ; i++)
+      {
+            struct stageStats *st = &currentStats.stages[i];
+            if(i > 0)
+                  sst_buffer_putc(&record, ',');
+            sst_buffer_append(&record, "{\"cmd\":", 7);
+            sst_buffer_append_json(&record, st->command);
+            snprintf(field, sizeof(field), ",\"pid\":%d,\"status\":%d,\"user_ms\":%.3f,\"sys_ms\":%.3f,\"maxrss_kb\":%ld}",
+                  (int)st->pid, st->status, sst_timeval_ms(&st->usage.ru_utime), sst_timeval_ms(&st->usage.ru_stime), st->usage.ru_maxrss);
+            sst_buffer_append(&record, field, strlen(field));
+      }
+      sst_buffer_append(&record, "]}\n", 3);
+      tracePush(record.data); //frees it
+}
+
+int sst_trace(char **args)
+{
+      if (args[1] == NULL)
+      {
+            if(traceSink.path != NULL)
+                  printf("trace is on: %s (%lu records dropped)\n", traceSink.path, traceSink.dropped);
+            else
+                  printf("trace is off\n");
+      }
+      else if (strcmp(args[1], "on") == 0 && args[2] != NULL)
+      {
+            off_t maxBytes = TRACE_DEFAULT_MAX_BYTES;
+            if(args[3] != NULL)
+                  maxBytes = atol(args[3]) * 1024;
+            if(maxBytes <= 0)
+            {
+                  fprintf(stderr, "sst: trace: bad size \"%s\"\n", args[3]);
+                  return 1;
+            }
+            traceStop();
+            traceStart(args[2], maxBytes);
+      }
+      else if (strcmp(args[1], "off") == 0)
+      {
+            traceStop();
+      }
+      else
+      {
+            fprintf(stderr, "sst: usage: trace on <file> [max KB] | trace off\n");
+      }
+      return 1;
+}
+
+#define SST_RL_BUFSIZE 1024
+#define SST_INPUT_BUFSIZE 65536
+
+char *sst_read_line(void)
+{
+      int bufsize = SST_RL_BUFSIZE;
+      int position = 0;
+      char *buffer = malloc(sizeof(char) * bufsize);
+      int c;
+
+      if (!buffer) 
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+
+      while (1) 
+      {
+            // Read a character
+            c = sst_getchar();
+
+            // If we hit EOF, replace it with a null character and return.
+            if (c == EOF || c == '\n') 
+            {
+                  buffer[position] = '\0';
+                  shellCounters.readBytes += position + (c == '\n');
+                  shellCounters.readLines++;
+                  return buffer;
+            } 
+            else 
+            {
+                  buffer[position] = c;
+            }
+            position++;
+
+            // If we have exceeded the buffer, reallocate.
+            if (position >= bufsize) 
+            {
+                  bufsize += SST_RL_BUFSIZE;
+                  buffer = realloc(buffer, bufsize);
+                  if (!buffer) 
+                  {
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
+                  }
+            }
+      }
+}
+
+#define SST_TOK_BUFSIZE 64
+
+
+char **sst_split_line(char *line, char *s)
+{
+      int bufsize = SST_TOK_BUFSIZE, position = 0;
+      char **tokens = malloc(bufsize * sizeof(char*));
+      char *token;
+
+      if (!tokens)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      //tokenizing the string
+      token = strtok(line, s);
+
+      while (token != NULL) 
+      {
+            tokens[position] = token;
+            position++;
+            shellCounters.tokens++;
+            if(strcmp(token,"|") == 0) //Assuming there are spaces between pipes
+            {
+                  pipeInInputFlag = 1;
+            }
+            if(strcmp(token,"<") == 0)
+            {
+                  redirectionLessThan = 1;
+            }
+            if(strcmp(token,">") == 0)
+            {
+                  redirectionGreaterThan = 1;
+            }
+            if (position >= bufsize) 
+            {
+                  shellCounters.tokenReallocs++;
+                  bufsize += SST_TOK_BUFSIZE;
+                  tokens = realloc(tokens, bufsize * sizeof(char*));
+                  if (!tokens)
+                  {
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
+                  }
+            }
+            //get next token
+            token = strtok(NULL, s);
+      }
+      tokens[position] = NULL;
+      return tokens;
+}
+
+#define SST_STREAM_BUFSIZE 65536
+
+void sst_buffer_init(struct sst_buffer *b)
+{
+      b->length = 0;
+      b->capacity = SST_RL_BUFSIZE;
+      b->data = malloc(b->capacity);
+      if (!b->data)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      b->data[0] = '\0';
+}
+
+void sst_buffer_append(struct sst_buffer *b, const char *data, size_t n)
+{
+      if (b->length + n + 1 > b->capacity) //keep room for a terminating null
+      {
+            while (b->length + n + 1 > b->capacity)
+            {
+                  b->capacity *= 2; //doubling keeps appends amortised O(1)
+            }
+            b->data = realloc(b->data, b->capacity);
+            if (!b->data)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+      }
+      memcpy(b->data + b->length, data, n);
+      b->length += n;
+      b->data[b->length] = '\0';
+}
+
+void sst_buffer_putc(struct sst_buffer *b, char c)
+{
+      if (b->length + 2 <= b->capacity)
+      {
+            b->data[b->length++] = c;
+            b->data[b->length] = '\0';
+      }
+      else
+      {
+            sst_buffer_append(b, &c, 1);
+      }
+}
+
+//Writes the whole buffer to fd and empties it. Returns -1 on a write error.
+int sst_buffer_flush(struct sst_buffer *b, int fd)
+{
+      size_t written = 0;
+      while (written < b->length)
+      {
+            ssize_t n = write(fd, b->data + written, b->length - written);
+            if (n < 0)
+            {
+                  if (errno == EINTR)
+                        continue;
+                  b->length = 0;
+                  return -1;
+            }
+            written += n;
+      }
+      b->length = 0;
+      return 0;
+}
+
+void sst_buffer_free(struct sst_buffer *b)
+{
+      free(b->data);
+      b->data = NULL;
+      b->length = 0;
+      b->capacity = 0;
+}
+
+/*
+  Shell variables. Every variable, including the environment the shell
+  started with, lives in a hash table and exported ones are passed to the
+  commands it runs. The envp array handed to exec is only rebuilt after an
+  exported variable changed; until then forked children share it
+  copy-on-write. "NAME=value" sets a variable, "NAME=value command" sets it
+  for that command only, export marks variables for the environment and
+  unset removes them.
+*/
+#define VAR_TABLE_SIZE 256
+
+struct variable
+{
+      char *name;
+      char *value;
+      int exported;
+      struct variable *next;
+};
+
+struct variable *varTable[VAR_TABLE_SIZE];
+char **envBlock = NULL; //NAME=value of every exported variable
+int envDirty = 1; //envBlock needs rebuilding
+char *scriptName = "ownsh"; //$0
+char **scriptArgs = NULL; //$1, $2, ...
+int scriptArgCount = 0; //$#
+
+struct variable *varFind(const char *name)
+{
+      struct variable *v = varTable[stringHash(name) % VAR_TABLE_SIZE];
+
+      while(v != NULL && strcmp(v->name, name) != 0)
+            v = v->next;
+      return v;
+}
+
+//The value of a shell variable, or NULL. Used instead of getenv.
+char *sst_getenv(const char *name)
+{
+      struct variable *v = varFind(name);
+      return v != NULL ? v->value : NULL;
+}
+
+//Sets a variable; export 1 also exports it, 0 leaves the flag as it is
+void varSet(const char *name, const char *value, int export)
+{
+      struct variable *v = varFind(name);
+      char *copy = strdup(value); //value may be v->value itself
+
+      if(v == NULL)
+      {
+            unsigned int bucket = stringHash(name) % VAR_TABLE_SIZE;
+            v = calloc(1, sizeof(struct variable));
+            if(!v)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+            v->name = strdup(name);
+            v->next = varTable[bucket];
+            varTable[bucket] = v;
+      }
+      else
+      {
+            free(v->value);
+      }
+      v->value = copy;
+      if(export)
+            v->exported = 1;
+      if(v->exported)
+            envDirty = 1;
+}
+
+void varUnset(const char *name)
+{
+      struct variable **link = &varTable[stringHash(name) % VAR_TABLE_SIZE];
+
+      while(*link != NULL && strcmp((*link)->name, name) != 0)
+            link = &(*link)->next;
+      if(*link == NULL)
+            return;
+      struct variable *v = *link;
+      *link = v->next;
+      if(v->exported)
+            envDirty = 1;
+      free(v->name);
+      free(v->value);
+      free(v);
+}
+
+//Returns the environment for exec, rebuilding it only if an exported variable changed
+char **sst_environ(void)
+{
+      struct variable *v;
+      int i, count = 0;
+
+      if(!envDirty)
+            return envBlock;
+      if(envBlock != NULL)
+      {
+            for(i = 0 ; envBlock[i] != NULL ; i++)
+                  free(envBlock[i]);
+            free(envBlock);
+      }
+      for(i = 0 ; i < VAR_TABLE_SIZE ; i++)
+      {
+            for(v = varTable[i] ; v != NULL ; v = v->next)
+                  count += v->exported;
+      }
+      envBlock = malloc(sizeof(char*) * (count + 1));
+      if(!envBlock)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      count = 0;
+      for(i = 0 ; i < VAR_TABLE_SIZE ; i++)
+      {
+            for(v = varTable[i] ; v != NULL ; v = v->next)
+            {
+                  if(!v->exported)
+                        continue;
+                  envBlock[count] = malloc(strlen(v->name) + strlen(v->value) + 2);
+                  if(!envBlock[count])
+                  {
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
+                  }
+                  sprintf(envBlock[count++], "%s=%s", v->name, v->value);
+            }
+      }
+      envBlock[count] = NULL;
+      envDirty = 0;
+      return envBlock;
+}
+
+//execvp with envp, which the shell built with sst_environ before forking, so
+//the block is rebuilt once per change rather than in every child. path is
+//tried first when it is not NULL. Counts the attempt and a failure.
+int sst_exec(char *path, char **args, char **envp)
+{
+      environ = envp; //so the PATH search sees the shell's PATH too
+      __atomic_add_fetch(&execCounters->attempts, 1, __ATOMIC_RELAXED);
+      if(path != NULL)
+            execv(path, args); //falls back to a PATH search if it moved
+      execvp(args[0], args);
+      __atomic_add_fetch(&execCounters->failures, 1, __ATOMIC_RELAXED);
+      return -1;
+}
+
+void varInit(void)
+{
+      char **e;
+
+      for(e = environ ; *e != NULL ; e++)
+      {
+            char *equals = strchr(*e, '=');
+            if(equals == NULL)
+                  continue;
+            char *name = strndup(*e, equals - *e);
+            varSet(name, equals + 1, 1);
+            free(name);
+      }
+}
+
+int sst_export(char **args)
+{
+      struct variable *v;
+      int i;
+
+      if (args[1] == NULL)
+      {
+            for (i = 0 ; i < VAR_TABLE_SIZE ; i++)
+            {
+                  for (v = varTable[i] ; v != NULL ; v = v->next)
+                  {
+                        if (v->exported)
+                              printf("export %s=\"%s\"\n", v->name, v->value);
+                  }
+            }
+            return 1;
+      }
+      for (i = 1 ; args[i] != NULL ; i++)
+      {
+            char *equals = strchr(args[i], '=');
+            if (equals != NULL)
+            {
+                  *equals = '\0';
+                  varSet(args[i], equals + 1, 1);
+            }
+            else if ((v = varFind(args[i])) != NULL)
+            {
+                  v->exported = 1;
+                  envDirty = 1;
+            }
+            else
+            {
+                  varSet(args[i], "", 1);
+            }
+      }
+      return 1;
+}
+
+int sst_unset(char **args)
+{
+      int i;
+
+      for (i = 1 ; args[i] != NULL ; i++)
+            varUnset(args[i]);
+      return 1;
+}
+
+//Length of the NAME= at the start of word, or 0 if it is not an assignment
+int assignmentLength(char *word)
+{
+      int i = 0;
+
+      if(!(word[0] == '_' || (word[0] >= 'A' && word[0] <= 'Z') || (word[0] >= 'a' && word[0] <= 'z')))
+            return 0;
+      while(word[i] == '_' || (word[i] >= 'A' && word[i] <= 'Z') || (word[i] >= 'a' && word[i] <= 'z') || (word[i] >= '0' && word[i] <= '9'))
+            i++;
+      return word[i] == '=' ? i + 1 : 0;
+}
+
+//Runs a line that starts with NAME=value words. Returns the status for the loop.
+int runAssignments(char *line)
+{
+      struct saved
+      {
+            char *name;
+            char *value; //NULL if it was not set
+            int exported;
+      } *saved = NULL;
+      int count = 0, i, status = 1;
+      char *p = line;
+
+      while(assignmentLength(p) > 0)
+      {
+            struct sst_buffer value;
+            char quote = 0;
+            char *name = strndup(p, assignmentLength(p) - 1);
+
+            sst_buffer_init(&value);
+            for(p += assignmentLength(p) ; *p != '\0' && (quote || (*p != ' ' && *p != '\t')) ; p++)
+            {
+                  if(quote && *p == quote)
+                        quote = 0;
+                  else if(!quote && (*p == '"' || *p == '\''))
+                        quote = *p;
+                  else
+                        sst_buffer_putc(&value, *p);
+            }
+            saved = realloc(saved, sizeof(struct saved) * (count + 1));
+            if(!saved)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+            struct variable *v = varFind(name);
+            saved[count].name = name;
+            saved[count].value = v != NULL ? strdup(v->value) : NULL;
+            saved[count].exported = v != NULL && v->exported;
+            count++;
+            varSet(name, unprotectWord(value.data), 0);
+            sst_buffer_free(&value);
+            while(*p == ' ' || *p == '\t')
+                  p++;
+      }
+      lastExitStatus = 0;
+      if(*p != '\0') //assignments for this command only
+      {
+            for(i = 0 ; i < count ; i++)
+                  varSet(saved[i].name, sst_getenv(saved[i].name), 1);
+            status = dispatchCommand(p);
+            for(i = count - 1 ; i >= 0 ; i--)
+            {
+                  if(saved[i].value == NULL)
+                        varUnset(saved[i].name);
+                  else
+                  {
+                        varSet(saved[i].name, saved[i].value, 0);
+                        varFind(saved[i].name)->exported = saved[i].exported;
+                        envDirty = 1;
+                  }
+            }
+      }
+      for(i = 0 ; i < count ; i++)
+      {
+            free(saved[i].name);
+            free(saved[i].value);
+      }
+      free(saved);
+      return status;
+}
+
+/*
+  Expanded text is made of plain words. While a value is spliced into the
+  line, the characters the executor reads as syntax are swapped for control
+  bytes, so a variable holding "a > file" cannot redirect anything, and they
+  are swapped back in each word once the line has been split.
+*/
+const char protectedChars[] = "|<>&;*"; //protected as bytes 1 to 6
+
+void protectExpansion(struct sst_buffer *result, size_t from)
+{
+      char *special;
+
+      for( ; from < result->length ; from++)
+      {
+            if(result->data[from] != '\0' && (special = strchr(protectedChars, result->data[from])) != NULL)
+                  result->data[from] = special - protectedChars + 1;
+      }
+}
+
+//Turns the protected bytes of one word back into the characters they stand for
+char *unprotectWord(char *word)
+{
+      char *p;
+
+      for(p = word ; p != NULL && *p != '\0' ; p++)
+      {
+            if(*p >= 1 && *p <= (char)strlen(protectedChars))
+                  *p = protectedChars[*p - 1];
+      }
+      return word;
+}
+
+void unprotectArgs(char **args)
+{
+      for( ; *args != NULL ; args++)
+            unprotectWord(*args);
+}
+
+//Appends the value of the parameter at p ($NAME, ${NAME}, $1, $?, $$, $#,
+//$0, $@ or $*) and returns the last character used, or NULL if p does not
+//start one.
+char *expandParameter(char *p, struct sst_buffer *result)
+{
+      char number[32], *name, *value = NULL, *end;
+      int i;
+
+      if(p[1] == '{')
+      {
+            end = strchr(p + 2, '}');
+            if(end == NULL)
+                  return NULL;
+            name = strndup(p + 2, end - p - 2);
+      }
+      else if(p[1] == '_' || (p[1] >= 'A' && p[1] <= 'Z') || (p[1] >= 'a' && p[1] <= 'z'))
+      {
+            end = p + 1;
+            while(end[1] == '_' || (end[1] >= 'A' && end[1] <= 'Z') || (end[1] >= 'a' && end[1] <= 'z') || (end[1] >= '0' && end[1] <= '9'))
+                  end++;
+            name = strndup(p + 1, end - p);
+      }
+      else if(p[1] != '\0' && strchr("?$#0123456789@*", p[1]) != NULL)
+      {
+            end = p + 1;
+            name = strndup(p + 1, 1);
+      }
+      else
+      {
+            return NULL;
+      }
+
+      if(strcmp(name, "?") == 0)
+            snprintf(value = number, sizeof(number), "%d", lastExitStatus);
+      else if(strcmp(name, "$") == 0)
+            snprintf(value = number, sizeof(number), "%d", (int)getpid());
+      else if(strcmp(name, "#") == 0)
+            snprintf(value = number, sizeof(number), "%d", scriptArgCount);
+      else if(strcmp(name, "0") == 0)
+            value = scriptName;
+      else if(strcmp(name, "@") == 0 || strcmp(name, "*") == 0)
+      {
+            for(i = 0 ; i < scriptArgCount ; i++)
+            {
+                  if(i > 0)
+                        sst_buffer_putc(result, ' ');
+                  sst_buffer_append(result, scriptArgs[i], strlen(scriptArgs[i]));
+            }
+      }
+      else if(name[0] >= '1' && name[0] <= '9' && strspn(name, "0123456789") == strlen(name))
+      {
+            i = atoi(name);
+            value = i <= scriptArgCount ? scriptArgs[i-1] : NULL;
+      }
+      else
+            value = sst_getenv(name);
+      if(value != NULL)
+            sst_buffer_append(result, value, strlen(value));
+      free(name);
+      return end;
+}
+
+/*
+  Command substitution. $(...) and `...` are replaced by the output of the
+  command inside, with trailing newlines removed. Output is read from a pipe
+  straight into a growable buffer. Builtins that only print (echo and
+  history) are run in the shell itself with stdout pointed at the buffer, so
+  they need neither a fork nor a pipe; everything else runs in a child so
+  a substitution cannot change the shell's state.
+  Parameters are expanded in the same pass over the line.
+*/
+ssize_t captureWrite(void *cookie, const char *data, size_t size)
+{
+      sst_buffer_append((struct sst_buffer *)cookie, data, size);
+      return size;
+}
+
+//True for a command that can be captured without forking: it only prints
+int isPrintOnlyBuiltin(char *command)
+{
+      char name[32];
+      int length = 0;
+
+      while(*command == ' ' || *command == '\t')
+            command++;
+      while(command[length] != '\0' && command[length] != ' ' && command[length] != '\t' && length < 31)
+      {
+            name[length] = command[length];
+            length++;
+      }
+      name[length] = '\0';
+      if(strpbrk(command, "|<>&`$") != NULL)
+            return 0;
+      if(aliasFind(name) != NULL) //could stand for anything
+            return 0;
+      return strcmp(name, "echo") == 0 || strcmp(name, "history") == 0;
+}
+
+//Runs command with run in a child and appends everything it writes to
+//stdout to out. With tee the output is also copied to the shell's stdout
+//as it arrives.
+void captureChild(char *command, struct sst_buffer *out, int (*run)(char *), int tee)
+{
+      int pipefd[2];
+      pid_t pid;
+      ssize_t n;
+
+      if(pipe(pipefd) < 0)
+      {
+            perror("sst");
+            return;
+      }
+      pid = sst_fork();
+      if(pid == 0)
+      {
+            close(pipefd[0]);
+            dup2(pipefd[1], STDOUT_FILENO);
+            close(pipefd[1]);
+            run(command);
+            fflush(stdout);
+            _exit(lastExitStatus);
+      }
+      close(pipefd[1]);
+      if(pid < 0)
+      {
+            perror("sst");
+            close(pipefd[0]);
+            return;
+      }
+      while(1)
+      {
+            if(out->capacity - out->length < SST_RL_BUFSIZE)
+            {
+                  out->capacity *= 2;
+                  out->data = realloc(out->data, out->capacity);
+                  if(!out->data)
+                  {
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
+                  }
+            }
+            n = read(pipefd[0], out->data + out->length, out->capacity - out->length - 1);
+            if(n < 0 && errno == EINTR)
+                  continue;
+            if(n <= 0)
+                  break;
+            if(tee && serveTransfer(STDOUT_FILENO, out->data + out->length, n, 1) < 0)
+                  tee = 0; //keep filling out for the caller
+            out->length += n;
+      }
+      out->data[out->length] = '\0';
+      close(pipefd[0]);
+      sst_wait(pid, command);
+}
+
+//Runs command and appends everything it writes to stdout to out
+void captureCommand(char *command, struct sst_buffer *out)
+{
+      cookie_io_functions_t io = {NULL, captureWrite, NULL, NULL};
+
+      if(isPrintOnlyBuiltin(command))
+      {
+            FILE *saved = stdout;
+            fflush(stdout);
+            stdout = fopencookie(out, "w", io);
+            if(stdout != NULL)
+            {
+                  checkForCommands(command);
+                  fclose(stdout);
+                  stdout = saved;
+                  return;
+            }
+            stdout = saved;
+      }
+      captureChild(command, out, checkForCommands, 0);
+}
+
+//Returns the end of a $( ... ) body that starts at p, or NULL if unbalanced
+char *matchingParenthesis(char *p)
+{
+      int depth = 1;
+      char quote = 0;
+
+      for( ; *p != '\0' ; p++)
+      {
+            if(quote)
+            {
+                  if(*p == quote)
+                        quote = 0;
+            }
+            else if(*p == '\'' || *p == '"')
+                  quote = *p;
+            else if(*p == '(')
+                  depth++;
+            else if(*p == ')' && --depth == 0)
+                  return p;
+      }
+      return NULL;
+}
+
+//Expands every parameter and substitution in line. Returns a new string, or
+//NULL if the line has none and can be used as it is.
+char *expandLine(char *line)
+{
+      struct sst_buffer result;
+      char *p, *end;
+      int inSingleQuotes = 0, inDoubleQuotes = 0;
+      int expanded = 0;
+
+      if(strchr(line, '$') == NULL && strchr(line, '`') == NULL)
+            return NULL;
+      sst_buffer_init(&result);
+      for(p = line ; *p != '\0' ; p++)
+      {
+            size_t before = result.length;
+            if(*p == '\'' && !inDoubleQuotes) //an apostrophe inside "..." is just a character
+                  inSingleQuotes = !inSingleQuotes;
+            else if(*p == '"' && !inSingleQuotes)
+                  inDoubleQuotes = !inDoubleQuotes;
+            end = NULL;
+            if(!inSingleQuotes && p[0] == '$' && p[1] == '(' && p[2] != '(') //$(( )) is arithmetic
+                  end = matchingParenthesis(p + 2);
+            else if(!inSingleQuotes && p[0] == '`')
+                  end = strchr(p + 1, '`');
+            else if(!inSingleQuotes && p[0] == '$' && (end = expandParameter(p, &result)) != NULL)
+            {
+                  protectExpansion(&result, before);
+                  expanded = 1;
+                  p = end;
+                  continue;
+            }
+            if(end == NULL)
+            {
+                  sst_buffer_putc(&result, *p);
+                  continue;
+            }
+            char *start = p[0] == '$' ? p + 2 : p + 1;
+            char *command = strndup(start, end - start);
+            captureCommand(command, &result);
+            free(command);
+            while(result.length > before && result.data[result.length-1] == '\n')
+                  result.length--;
+            result.data[result.length] = '\0';
+            protectExpansion(&result, before);
+            expanded = 1;
+            p = end;
+      }
+      if(!expanded)
+      {
+            sst_buffer_free(&result);
+            return NULL;
+      }
+      return result.data;
+}
+
+/*
+  Output cache. "memo <command>" keys the command's stdout and exit status
+  on everything that decides them for a deterministic command: the line
+  after alias expansion, the inode and mtime of every binary it runs, the
+  cwd, the variables listed in SST_MEMO_ENV and the inode, mtime and size of
+  a < input and the body of a here-document. On a hit the output is
+  replayed without running anything.
+  Entries live in ~/.cache/ownsh/memo, are touched when used and the least
+  recently used ones are evicted past SST_MEMO_MAX bytes (default 64M).
+  On a miss the line, already expanded, goes straight to dispatchCommand in
+  a child whose output is shown as it arrives and kept for the cache.
+  Lines that write files with > or run in the background are not cached,
+  and neither are builtins: they run inside the shell, so a replay would
+  skip what they change (cd, export) or show stale state (jobs, history).
+*/
+#define MEMO_MAGIC "sstmemo1"
+#define MEMO_DEFAULT_MAX (64L << 20)
+#define MEMO_DEFAULT_ENV "PATH HOME LANG LC_ALL TZ"
+
+struct memoHeader
+{
+      char magic[8];
+      uint32_t keyLength;
+      int32_t status;
+      uint64_t outputLength;
+};
+
+//Appends "dev:ino:mtime:size" of path to the key, or "-" if it does not exist
+void memoKeyFile(struct sst_buffer *key, char *path)
+{
+      struct stat st;
+      char text[128];
+
+      if(stat(path, &st) < 0)
+      {
+            sst_buffer_append(key, "-\n", 2);
+            return;
+      }
+      snprintf(text, sizeof(text), "%lu:%lu:%ld.%09ld:%ld\n", (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+            (long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, (long)st.st_size);
+      sst_buffer_append(key, text, strlen(text));
+}
+
+//Appends the identity of the program a stage runs, a file found in PATH.
+//Returns -1 for a builtin.
+int memoKeyProgram(struct sst_buffer *key, char *name)
+{
+      char *path;
+      int i;
+
+      for(i = 0 ; i < sst_num_builtins() ; i++)
+      {
+            if(strcmp(name, builtin_str[i]) == 0)
+                  return -1;
+      }
+      sst_buffer_append(key, name, strlen(name));
+      sst_buffer_putc(key, ' ');
+      path = commandLookup(name);
+      memoKeyFile(key, path != NULL ? path : name);
+      return 0;
+}
+
+//True if word is the whole first word of line
+int memoFirstWord(char *line, char *word)
+{
+      size_t length = strlen(word);
+      return strncmp(line, word, length) == 0 && (line[length] == '\0' || line[length] == ' ' || line[length] == '\t');
+}
+
+//Builds the cache key of line. Returns -1 for lines that cannot be cached.
+int memoKey(char *line, struct sst_buffer *key)
+{
+      char *check = checkAlias(line);
+      char *text, *copy, *stage, *word, *saveStage, *saveWord, *env, *name;
+      char *cwd;
+
+      //the lines dispatchCommand runs inside the shell
+      if(strcmp(line, "history") == 0 || strcmp(line, "shell editor") == 0 || strcmp(line, "ls -z") == 0 || strcmp(line, "ls -itime") == 0
+            || memoFirstWord(line, "alias") || memoFirstWord(line, "cat2") || memoFirstWord(line, "if"))
+            return -1;
+      if(check != NULL)
+            line = check;
+      if(strchr(line, '>') != NULL || strchr(line, '&') != NULL)
+            return -1;
+      sst_buffer_append(key, line, strlen(line));
+      sst_buffer_putc(key, '\n');
+      cwd = getcwd(NULL, 0);
+      if(cwd != NULL)
+            sst_buffer_append(key, cwd, strlen(cwd));
+      sst_buffer_putc(key, '\n');
+      free(cwd);
+
+      //the program of every stage, and the < input
+      copy = strdup(line);
+      for(stage = strtok_r(copy, "|", &saveStage) ; stage != NULL ; stage = strtok_r(NULL, "|", &saveStage))
+      {
+            text = strchr(stage, '<');
+            if(text != NULL)
+            {
+                  *text++ = '\0';
+                  word = strtok_r(text, " \t", &saveWord);
+                  if(word != NULL)
+                  {
+                        sst_buffer_append(key, "< ", 2);
+                        memoKeyFile(key, word);
+                  }
+            }
+            word = strtok_r(stage, " \t", &saveWord);
+            if(word != NULL && memoKeyProgram(key, word) < 0)
+            {
+                  free(copy);
+                  return -1;
+            }
+      }
+      free(copy);
+      if(heredocBodies.length > 0)
+      {
+            sst_buffer_append(key, "<< ", 3);
+            sst_buffer_append(key, heredocBodies.data, heredocBodies.length);
+      }
+
+      env = strdup(sst_getenv("SST_MEMO_ENV") != NULL ? sst_getenv("SST_MEMO_ENV") : MEMO_DEFAULT_ENV);
+      for(name = strtok_r(env, " ,:", &saveWord) ; name != NULL ; name = strtok_r(NULL, " ,:", &saveWord))
+      {
+            text = sst_getenv(name);
+            sst_buffer_append(key, name, strlen(name));
+            sst_buffer_putc(key, '=');
+            if(text != NULL)
+                  sst_buffer_append(key, text, strlen(text));
+            sst_buffer_putc(key, '\n');
+      }
+      free(env);
+      return 0;
+}
+
+//Replays the entry in fd if it belongs to key. Returns 0 on a hit.
+int memoReplay(int fd, struct sst_buffer *key)
+{
+      struct memoHeader header;
+      char data[SST_STREAM_BUFSIZE];
+      char *stored;
+      uint64_t left;
+      ssize_t n;
+
+      if(read(fd, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, MEMO_MAGIC, 8) != 0 || header.keyLength != key->length)
+            return -1;
+      stored = malloc(header.keyLength);
+      if(!stored)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      n = read(fd, stored, header.keyLength);
+      if(n != (ssize_t)header.keyLength || memcmp(stored, key->data, header.keyLength) != 0)
+      {
+            free(stored);
+            return -1; //a different command with the same hash
+      }
+      free(stored);
+      fflush(stdout);
+      for(left = header.outputLength ; left > 0 ; left -= n)
+      {
+            n = read(fd, data, left < sizeof(data) ? left : sizeof(data));
+            if(n <= 0 || write(STDOUT_FILENO, data, n) != n)
+                  break;
+      }
+      futimens(fd, NULL); //most recently used
+      lastExitStatus = header.status;
+      return 0;
+}
+
+//Removes the least recently used entries until the cache fits in SST_MEMO_MAX
+void memoEvict(char *dir)
+{
+      struct memoEntry
+      {
+            char *name;
+            off_t size;
+            time_t used;
+      } *entries = NULL;
+      int count = 0, capacity = 0, i, j;
+      long long total = 0, limit = MEMO_DEFAULT_MAX;
+      DIR *d = opendir(dir);
+      struct dirent *entry;
+      struct stat st;
+      char path[4096];
+
+      if(sst_getenv("SST_MEMO_MAX") != NULL)
+      {
+            char *unit;
+            limit = strtoll(sst_getenv("SST_MEMO_MAX"), &unit, 10);
+            if(*unit == 'K' || *unit == 'k')
+                  limit <<= 10;
+            else if(*unit == 'M' || *unit == 'm')
+                  limit <<= 20;
+            else if(*unit == 'G' || *unit == 'g')
+                  limit <<= 30;
+      }
+      if(d == NULL)
+            return;
+      while((entry = readdir(d)) != NULL)
+      {
+            if(entry->d_name[0] == '.')
+                  continue;
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            if(stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+                  continue;
+            if(count >= capacity)
+            {
+                  capacity = capacity ? capacity * 2 : 64;
+                  entries = realloc(entries, sizeof(struct memoEntry) * capacity);
+                  if(!entries)
+                  {
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
+                  }
+            }
+            entries[count].name = strdup(entry->d_name);
+            entries[count].size = st.st_size;
+            entries[count].used = st.st_mtime;
+            total += st.st_size;
+            count++;
+      }
+      closedir(d);
+      while(total > limit && count > 0)
+      {
+            for(i = 0, j = 1 ; j < count ; j++) //oldest entry
+            {
+                  if(entries[j].used < entries[i].used)
+                        i = j;
+            }
+            snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+            unlink(path);
+            total -= entries[i].size;
+            free(entries[i].name);
+            entries[i] = entries[--count];
+      }
+      for(i = 0 ; i < count ; i++)
+            free(entries[i].name);
+      free(entries);
+}
+
+//Runs line through the cache
+int memoRun(char *line)
+{
+      struct sst_buffer key, output;
+      struct memoHeader header;
+      uint64_t hash = 14695981039346656037ULL; //FNV-1a
+      char *dir, path[4096], temp[4096];
+      size_t i;
+      int fd;
+
+      sst_buffer_init(&key);
+      if(memoKey(line, &key) < 0)
+      {
+            sst_buffer_free(&key);
+            return dispatchCommand(line);
+      }
+      for(i = 0 ; i < key.length ; i++)
+      {
+            hash ^= (unsigned char)key.data[i];
+            hash *= 1099511628211ULL;
+      }
+      dir = cacheDirectory("memo");
+      snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)hash);
+
+      fd = open(path, O_RDONLY);
+      if(fd >= 0 && memoReplay(fd, &key) == 0)
+      {
+            close(fd);
+            shellCounters.memoHits++;
+            sst_buffer_free(&key);
+            free(dir);
+            return 1;
+      }
+      if(fd >= 0)
+            close(fd);
+      shellCounters.memoMisses++;
+
+      sst_buffer_init(&output);
+      captureChild(line, &output, dispatchCommand, 1); //expanding it again would run what the key does not describe
+      header.outputLength = output.length;
+      //commands that were killed or timed out did not produce their real output
+      if(!currentStats.timedOut && lastExitStatus < 128)
+      {
+            snprintf(temp, sizeof(temp), "%s/.tmp.XXXXXX", dir);
+            fd = mkstemp(temp);
+            if(fd >= 0)
+            {
+                  memcpy(header.magic, MEMO_MAGIC, 8);
+                  header.keyLength = key.length;
+                  header.status = lastExitStatus;
+                  if(write(fd, &header, sizeof(header)) == sizeof(header) && sst_buffer_flush(&key, fd) == 0
+                        && sst_buffer_flush(&output, fd) == 0 && rename(temp, path) == 0)
+                  {
+                        memoEvict(dir);
+                  }
+                  else
+                  {
+                        unlink(temp);
+                  }
+                  close(fd);
+            }
+      }
+      sst_buffer_free(&output);
+      sst_buffer_free(&key);
+      free(dir);
+      return 1;
+}
+
+//Runs one command line. A leading "time" (or "timing on") reports the
+//resource usage of every process the line started, and "timeout <duration>"
+//kills the line's processes when it runs too long. "limit --mem <size>
+//--cpu <cores>" runs them in a cgroup of their own. "memo" replays the
+//output of an earlier identical run. <<EOF and <<< redirect the command's
+//stdin from a here-document or a here-string.
+int checkForCommands(char *line)
+{
+      int status;
+      int savedStdin = -1;
+      int timeFlag = 0;
+      int memoFlag = 0;
+      int limitFlag = 0;
+      long long memoryLimit = 0;
+      double cpuLimit = 0;
+      struct jobLimit savedLimit;
+      double timeout = 0;
+      int ownStats;
+      struct commandStats saved;
+      char *traceLine = NULL;
+      char *expanded;
+
+      while(*line == ' ' || *line == '\t')
+            line++;
+      if(strncmp(line, "time", 4) == 0 && (line[4] == ' ' || line[4] == '\t'))
+      {
+            timeFlag = 1;
+            line += 5;
+            while(*line == ' ' || *line == '\t')
+                  line++;
+      }
+      if(strncmp(line, "timeout", 7) == 0 && (line[7] == ' ' || line[7] == '\t'))
+      {
+            char *duration = line + 8;
+            while(*duration == ' ' || *duration == '\t')
+                  duration++;
+            line = duration;
+            while(*line != '\0' && *line != ' ' && *line != '\t')
+                  line++;
+            if(*line != '\0')
+                  *line++ = '\0';
+            timeout = parseDuration(duration);
+            if(timeout < 0 || *line == '\0')
+            {
+                  fprintf(stderr, "sst: usage: timeout <duration>[ms|s|m|h] <command>\n");
+                  lastExitStatus = 2;
+                  return 1;
+            }
+      }
+      else if(statsDepth == 0 && defaultTimeout > 0)
+      {
+            timeout = defaultTimeout;
+      }
+      if(strncmp(line, "limit", 5) == 0 && (line[5] == ' ' || line[5] == '\t'))
+      {
+            limitFlag = 1;
+            line += 6;
+            while(limitFlag)
+            {
+                  char *option, *value;
+                  while(*line == ' ' || *line == '\t')
+                        line++;
+                  if(strncmp(line, "--", 2) != 0)
+                        break;
+                  option = line;
+                  line += strcspn(line, " \t");
+                  if(*line != '\0')
+                        *line++ = '\0';
+                  while(*line == ' ' || *line == '\t')
+                        line++;
+                  value = line;
+                  line += strcspn(line, " \t");
+                  if(*line != '\0')
+                        *line++ = '\0';
+                  if(strcmp(option, "--mem") == 0 && (memoryLimit = parseSize(value)) > 0)
+                        continue;
+                  if(strcmp(option, "--cpu") == 0 && (cpuLimit = strtod(value, &value)) > 0 && *value == '\0')
+                        continue;
+                  limitFlag = 0; //unknown option or bad value
+            }
+            if(!limitFlag || *line == '\0' || (memoryLimit == 0 && cpuLimit == 0))
+            {
+                  fprintf(stderr, "sst: usage: limit [--mem <size>[K|M|G]] [--cpu <cores>] <command>\n");
+                  lastExitStatus = 2;
+                  return 1;
+            }
+      }
+      if(strncmp(line, "memo", 4) == 0 && (line[4] == ' ' || line[4] == '\t'))
+      {
+            memoFlag = 1;
+            line += 5;
+            while(*line == ' ' || *line == '\t')
+                  line++;
+      }
+      ownStats = (statsDepth == 0 || timeFlag || timeout > 0 || limitFlag);
+      if(ownStats)
+      {
+            saved = currentStats;
+            sst_stats_begin();
+            if(timeout > 0)
+                  sst_set_deadline(timeout);
+            else if(saved.hasDeadline) //a nested line keeps the outer deadline
+            {
+                  currentStats.hasDeadline = 1;
+                  currentStats.deadline = saved.deadline;
+                  currentStats.timeoutSeconds = saved.timeoutSeconds;
+            }
+            if(traceSink.path != NULL)
+                  traceLine = strdup(line); //the tokenizer overwrites line
+      }
+      if(limitFlag)
+      {
+            savedLimit = currentLimit;
+            limitStart(memoryLimit, cpuLimit);
+      }
+      statsDepth++;
+      expanded = expandLine(line); //substitutions count towards this command
+      if(expanded != NULL)
+            line = expanded;
+      if(strstr(line, "<<") != NULL && heredocApply(line, &savedStdin) < 0)
+      {
+            lastExitStatus = 2;
+            status = 1;
+      }
+      else if(assignmentLength(line) > 0)
+            status = runAssignments(line);
+      else if(memoFlag)
+            status = memoRun(line);
+      else
+            status = dispatchCommand(line);
+      heredocRestore(savedStdin);
+      statsDepth--;
+      if(limitFlag)
+      {
+            limitFinish();
+            currentLimit = savedLimit;
+      }
+      if(ownStats)
+      {
+            clock_gettime(CLOCK_MONOTONIC, &currentStats.end);
+            sst_restore_terminal();
+            if(currentStats.timedOut)
+            {
+                  lastExitStatus = TIMEOUT_EXIT_STATUS;
+                  fprintf(stderr, "sst: timed out after %.3g s\n", currentStats.timeoutSeconds);
+            }
+            if(timeFlag || (shellOptions.timing && currentStats.stageCount > 0))
+                  sst_stats_print();
+            if(traceLine != NULL)
+            {
+                  traceCommand(traceLine);
+                  free(traceLine);
+            }
+            sst_stats_end();
+            currentStats = saved;
+      }
+      free(expanded);
+      return status;
+}
+
+int dispatchCommand(char *line)
+{
+      int status = 1;
+      struct timespec parseStart;
+      char **args;
+      char *copyLine = malloc(sizeof(char)*(strlen(line)+1));
+      strcpy(copyLine,line);
+
+      if(strcmp(line,"history") == 0)
+      {
+            historyPrint();
             status=1;
       }
-      else if(strncmp(copyLine,"alias",5)==0)
+      else if(strncmp(copyLine,"alias",5)==0)
+      {
+            aliasFunc(copyLine);
+            status = 1;
+      }
+      else if(strcmp(copyLine,"shell editor")==0)
+      {
+            status = editor();
+      }
+      else if(strncmp(copyLine,"cat2",4) == 0)
+      {
+            cat2Function(copyLine);
+            status = 1;
+      }
+      else if(strncmp(copyLine,"if",2)==0)
+      {
+            checkIFSyntax(copyLine);
+            status = 1;
+      }
+      else if(strcmp(copyLine,"ls -z") == 0)
+      {
+            printZeroSizeFiles();
+            status = 1;
+      }
+      else if(strcmp(copyLine, "ls -itime") == 0)
+      {
+            sortWithINodeTime();
+            status = 1;
+      }
+      else 
+      {
+            clock_gettime(CLOCK_MONOTONIC, &parseStart);
+            char *check = checkAlias(line);
+            if(check != NULL)
+            {
+                  args = sst_split_line(strdup(check)," \t\r\n\a"); //the alias itself must stay intact
+            }
+            else
+            {
+                  args = sst_split_line(line," \t\r\n\a");
+            }
+            histogramRecord(&parseLatency, &parseStart);
+            if(redirectionGreaterThan == 1 && redirectionLessThan == 1 && pipeInInputFlag == 1)
+            {
+                  pipeInputOutput(copyLine);
+            }
+            else if(redirectionGreaterThan == 1 && pipeInInputFlag == 1)
+            {
+                  pipeAndOutput(copyLine);
+            }
+            else if(redirectionLessThan == 1 && pipeInInputFlag == 1)
+            {
+                  pipeAndInput(copyLine);
+            }
+            else if(redirectionLessThan == 1 && redirectionGreaterThan == 1)
+            {
+                  onlyRedirection(copyLine);
+            }
+            else if(redirectionLessThan == 1)
+            {
+                  readFromInputFile(copyLine);
+            }
+            else if(redirectionGreaterThan == 1)
+            {
+                  readFromOutputFile(copyLine);
+            }
+            else if(pipeInInputFlag == 1)
+            {
+                  char **token;
+                  token = sst_split_line(copyLine,"|");
+                  parsePipedInput(token, -1, -1);
+                  status=1;
+            }
+            else
+            {
+                  int index = 0;
+                  while(copyLine[index] != '\0')
+                  {
+                        if(copyLine[index] == '*')
+                        {
+                              starFlag = 1;
+                              break;
+                        }
+                        index++;
+                  }
+                  if(starFlag != 1)
+                  {
+                        status = sst_execute(args);
+                  }
+                  else
+                  {
+                        char **tokens = sst_split_line(copyLine, " ");
+                        char *regex = tokens[1];
+                        printFilesWithRegex(unprotectWord(regex));
+                        starFlag = 0;
+                        status = 1;
+                  }
+            }     
+      }
+      return status;
+}
+
+struct node* newNode(char *data)
+{
+      struct node *temp = malloc(sizeof(struct node));
+      temp -> data = (char*)malloc(sizeof(char)*(strlen(data)+1));
+      strcpy(temp->data, data);
+      temp -> prev = NULL;
+      temp -> next = NULL;
+      return temp;
+}
+
+void historyPrint()
+{
+      int i;
+      struct node *temp = head;
+      while(temp != NULL)
+      {
+            printf("%s     %s      \n",temp->data,temp->timestamp);
+            temp = temp->next;
+      }
+}
+
+void aliasFunc(char * line)
+{
+      char **token;
+      char **token1;
+      token = sst_split_line(line,"=\"");
+      token1 = sst_split_line(token[0]," ");
+      if(token1[1] == NULL || token[1] == NULL)
+      {
+            fprintf(stderr, "sst: usage: alias name=\"command\"\n");
+            return;
+      }
+      aliasSet(token1[1], token[1], 0);
+}
+char* checkAlias(char *line)
+{
+      shellCounters.aliasLookups++;
+      struct aliasEntry *e = aliasFind(line);
+      if(e != NULL)
+      {
+            return e->value;
+      }
+      else
+      {
+            return NULL;
+      }
+}
+
+/*
+  Alias and command tables. Aliases are kept in a chained hash table keyed
+  by the alias name. Commands run by sst_launch are looked up in PATH once
+  and remembered until PATH changes ("hash" lists them, "hash -r" forgets
+  them). Strings of entries loaded from the startup snapshot point into the
+  snapshot mapping and are never freed.
+*/
+unsigned int stringHash(const char *s)
+{
+      unsigned int hash = 2166136261u; //FNV-1a
+
+      while(*s != '\0')
+      {
+            hash ^= (unsigned char)*s++;
+            hash *= 16777619u;
+      }
+      return hash;
+}
+
+struct aliasEntry *aliasFind(char *name)
+{
+      struct aliasEntry *e = aliasTable[stringHash(name) % ALIAS_TABLE_SIZE];
+
+      while(e != NULL && strcmp(e->name, name) != 0)
+            e = e->next;
+      return e;
+}
+
+//Adds or replaces an alias. Both strings are copied unless mapped is set.
+//Definitions made in the session override the rc one but leave it in place
+//for the snapshot.
+void aliasSet(char *name, char *value, int mapped)
+{
+      struct aliasEntry *e = aliasFind(name);
+      int fromRc = loadingRc || mapped;
+
+      if(e == NULL)
+      {
+            unsigned int bucket = stringHash(name) % ALIAS_TABLE_SIZE;
+            e = malloc(sizeof(struct aliasEntry));
+            if(!e)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+            e->name = mapped ? name : strdup(name);
+            e->value = NULL;
+            e->rcValue = NULL;
+            e->mapped = mapped;
+            e->next = aliasTable[bucket];
+            aliasTable[bucket] = e;
+            aliasCount++;
+      }
+      if(e->value != e->rcValue)
+            free(e->value); //a session definition is always a copy
+      if(fromRc)
+      {
+            if(!e->mapped)
+                  free(e->rcValue);
+            e->rcValue = mapped ? value : strdup(value);
+            e->value = e->rcValue;
+      }
+      else
+      {
+            e->value = strdup(value);
+      }
+}
+
+void commandTableClear(void)
+{
+      int i;
+
+      for(i = 0 ; i < COMMAND_TABLE_SIZE ; i++)
+      {
+            while(commandTable[i] != NULL)
+            {
+                  struct commandEntry *e = commandTable[i];
+                  commandTable[i] = e->next;
+                  if(!e->mapped)
+                  {
+                        free(e->name);
+                        free(e->path);
+                        free(e);
+                  }
+            }
+      }
+      commandCount = 0;
+      commandTableDirty = 1;
+}
+
+void commandAdd(char *name, char *path, int mapped)
+{
+      unsigned int bucket = stringHash(name) % COMMAND_TABLE_SIZE;
+      struct commandEntry *e = malloc(sizeof(struct commandEntry));
+
+      if(!e)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      e->name = mapped ? name : strdup(name);
+      e->path = mapped ? path : strdup(path);
+      e->mapped = mapped;
+      e->next = commandTable[bucket];
+      commandTable[bucket] = e;
+      commandCount++;
+}
+
+//Returns the full path of the program name runs, or NULL if it is not in PATH
+char *commandLookup(char *name)
+{
+      char *pathVariable = sst_getenv("PATH");
+      char *path, *dir, *candidate, *found = NULL;
+      struct commandEntry *e;
+      struct stat st;
+
+      if(pathVariable == NULL || strchr(name, '/') != NULL)
+            return NULL;
+      if(commandTablePath == NULL || strcmp(commandTablePath, pathVariable) != 0)
+      {
+            commandTableClear();
+            free(commandTablePath);
+            commandTablePath = strdup(pathVariable);
+      }
+      for(e = commandTable[stringHash(name) % COMMAND_TABLE_SIZE] ; e != NULL ; e = e->next)
+      {
+            if(strcmp(e->name, name) == 0)
+                  return e->path;
+      }
+      path = strdup(pathVariable);
+      candidate = malloc(strlen(path) + strlen(name) + 2);
+      for(dir = strtok(path, ":") ; dir != NULL ; dir = strtok(NULL, ":"))
+      {
+            sprintf(candidate, "%s/%s", dir, name);
+            if(stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0)
+            {
+                  commandAdd(name, candidate, 0);
+                  commandTableDirty = 1;
+                  found = commandTable[stringHash(name) % COMMAND_TABLE_SIZE]->path;
+                  break;
+            }
+      }
+      free(candidate);
+      free(path);
+      return found;
+}
+
+int sst_hash(char **args)
+{
+      struct commandEntry *e;
+      int i;
+
+      if (args[1] != NULL && strcmp(args[1], "-r") == 0)
+      {
+            commandTableClear();
+            return 1;
+      }
+      for (i = 0 ; i < COMMAND_TABLE_SIZE ; i++)
+      {
+            for (e = commandTable[i] ; e != NULL ; e = e->next)
+                  printf("%-16s %s\n", e->name, e->path);
+      }
+      return 1;
+}
+
+/*
+  Startup snapshot. The state built by ~/.ownshrc (or $SST_RC) - its
+  aliases, the options it set and the command table - is written to
+  ~/.cache/ownsh/snapshot/state and loaded with a single mmap on the next
+  start instead of running the rc file again. Everything in the file is
+  addressed by offsets from its start, so it does not matter where it is
+  mapped. The snapshot is rebuilt when the rc file's inode, mtime or size
+  changes, or the format version does; the command table is only used if
+  PATH is the same. An rc file with anything but alias, timing, pipesize
+  and pipestat lines is always run, since its other commands may have
+  side effects.
+*/
+#define SNAPSHOT_MAGIC "sstsnap"
+#define SNAPSHOT_VERSION 2
+
+struct snapshotHeader
+{
+      char magic[8];
+      uint32_t version;
+      uint32_t size; //of the whole file
+      uint64_t rcDevice;
+      uint64_t rcInode;
+      int64_t rcSize;
+      int64_t rcMtimeSec;
+      int64_t rcMtimeNsec;
+      struct shellOptions options;
+      uint32_t rcPath; //offsets of NUL terminated strings
+      uint32_t path;
+      uint32_t aliasCount;
+      uint32_t aliases; //offset of aliasCount snapshotPairs
+      uint32_t commandCount;
+      uint32_t commands;
+};
+
+struct snapshotPair
+{
+      uint32_t name;
+      uint32_t value;
+};
+
+struct shellOptions rcOptions; //options as the rc file left them
+char *rcPath = NULL;
+int snapshotAllowed = 0;
+
+//Returns the malloc'd path of ~/.cache/ownsh/<name>, creating it if needed
+char *cacheDirectory(char *name)
+{
+      char *base = sst_getenv("XDG_CACHE_HOME");
+      char *dir, *p;
+      struct sst_buffer path;
+
+      sst_buffer_init(&path);
+      if(base != NULL && base[0] != '\0')
+            sst_buffer_append(&path, base, strlen(base));
+      else
+      {
+            base = sst_getenv("HOME") != NULL ? sst_getenv("HOME") : "/tmp";
+            sst_buffer_append(&path, base, strlen(base));
+            sst_buffer_append(&path, "/.cache", 7);
+      }
+      sst_buffer_append(&path, "/ownsh/", 7);
+      sst_buffer_append(&path, name, strlen(name));
+      dir = path.data;
+      for(p = dir + 1 ; *p != '\0' ; p++)
+      {
+            if(*p == '/')
+            {
+                  *p = '\0';
+                  mkdir(dir, 0700);
+                  *p = '/';
+            }
+      }
+      mkdir(dir, 0700);
+      return dir;
+}
+
+char *snapshotFile(void)
+{
+      char *dir = cacheDirectory("snapshot");
+      char *file = malloc(strlen(dir) + 7);
+
+      if(!file)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      sprintf(file, "%s/state", dir);
+      free(dir);
+      return file;
+}
+
+//Appends s to the string pool and returns its offset in the file
+uint32_t snapshotString(struct sst_buffer *strings, uint32_t base, char *s)
+{
+      uint32_t offset = base + strings->length;
+
+      sst_buffer_append(strings, s, strlen(s) + 1);
+      return offset;
+}
+
+void snapshotSave(void)
+{
+      struct snapshotHeader header;
+      struct sst_buffer pairs, strings;
+      struct snapshotPair pair;
+      struct aliasEntry *a;
+      struct commandEntry *c;
+      struct stat st;
+      uint32_t base;
+      char *file, *temp;
+      int i, fd;
+
+      if(!snapshotAllowed || stat(rcPath, &st) < 0)
+            return;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+      header.version = SNAPSHOT_VERSION;
+      header.rcDevice = st.st_dev;
+      header.rcInode = st.st_ino;
+      header.rcSize = st.st_size;
+      header.rcMtimeSec = st.st_mtim.tv_sec;
+      header.rcMtimeNsec = st.st_mtim.tv_nsec;
+      header.options = rcOptions;
+      for(i = 0 ; i < ALIAS_TABLE_SIZE ; i++)
+      {
+            for(a = aliasTable[i] ; a != NULL ; a = a->next)
+                  header.aliasCount += a->rcValue != NULL;
+      }
+      header.commandCount = commandTablePath != NULL ? commandCount : 0;
+      header.aliases = sizeof(header);
+      header.commands = header.aliases + header.aliasCount * sizeof(pair);
+      base = header.commands + header.commandCount * sizeof(pair);
+
+      sst_buffer_init(&pairs);
+      sst_buffer_init(&strings);
+      header.rcPath = snapshotString(&strings, base, rcPath);
+      header.path = snapshotString(&strings, base, commandTablePath != NULL ? commandTablePath : "");
+      for(i = 0 ; i < ALIAS_TABLE_SIZE ; i++)
+      {
+            for(a = aliasTable[i] ; a != NULL ; a = a->next)
+            {
+                  if(a->rcValue == NULL)
+                        continue;
+                  pair.name = snapshotString(&strings, base, a->name);
+                  pair.value = snapshotString(&strings, base, a->rcValue);
+                  sst_buffer_append(&pairs, (char *)&pair, sizeof(pair));
+            }
+      }
+      for(i = 0 ; i < COMMAND_TABLE_SIZE && header.commandCount > 0 ; i++)
+      {
+            for(c = commandTable[i] ; c != NULL ; c = c->next)
+            {
+                  pair.name = snapshotString(&strings, base, c->name);
+                  pair.value = snapshotString(&strings, base, c->path);
+                  sst_buffer_append(&pairs, (char *)&pair, sizeof(pair));
+            }
+      }
+      header.size = base + strings.length;
+
+      file = snapshotFile();
+      temp = malloc(strlen(file) + 8);
+      if(!temp)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      sprintf(temp, "%s.XXXXXX", file);
+      fd = mkstemp(temp);
+      if(fd >= 0)
+      {
+            if(write(fd, &header, sizeof(header)) != sizeof(header) || sst_buffer_flush(&pairs, fd) < 0
+                  || sst_buffer_flush(&strings, fd) < 0 || rename(temp, file) < 0)
+            {
+                  unlink(temp);
+            }
+            close(fd);
+      }
+      commandTableDirty = 0;
+      free(temp);
+      free(file);
+      sst_buffer_free(&pairs);
+      sst_buffer_free(&strings);
+}
+
+//Loads the snapshot if it is still valid for the rc file. Returns 0 on success.
+int snapshotLoad(struct stat *rc)
+{
+      char *file = snapshotFile();
+      int fd = open(file, O_RDONLY | O_CLOEXEC);
+      struct snapshotHeader *header;
+      struct snapshotPair *pairs;
+      struct stat st;
+      char *map;
+      uint32_t i;
+
+      free(file);
+      if(fd < 0)
+            return -1;
+      if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct snapshotHeader))
+      {
+            close(fd);
+            return -1;
+      }
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if(map == MAP_FAILED)
+            return -1;
+      header = (struct snapshotHeader *)map;
+      if(memcmp(header->magic, SNAPSHOT_MAGIC, 8) != 0 || header->version != SNAPSHOT_VERSION
+            || header->size != st.st_size || map[st.st_size - 1] != '\0'
+            || header->rcDevice != rc->st_dev || header->rcInode != rc->st_ino || header->rcSize != rc->st_size
+            || header->rcMtimeSec != rc->st_mtim.tv_sec || header->rcMtimeNsec != rc->st_mtim.tv_nsec
+            || header->rcPath >= header->size || strcmp(map + header->rcPath, rcPath) != 0
+            || header->commands + (uint64_t)header->commandCount * sizeof(struct snapshotPair) > header->size
+            || header->aliases + (uint64_t)header->aliasCount * sizeof(struct snapshotPair) > header->commands)
+      {
+            munmap(map, st.st_size);
+            return -1;
+      }
+
+      pairs = (struct snapshotPair *)(map + header->aliases);
+      for(i = 0 ; i < header->aliasCount ; i++)
+      {
+            if(pairs[i].name < header->size && pairs[i].value < header->size)
+                  aliasSet(map + pairs[i].name, map + pairs[i].value, 1);
+      }
+      if(sst_getenv("PATH") != NULL && header->path < header->size && strcmp(map + header->path, sst_getenv("PATH")) == 0)
+      {
+            commandTablePath = strdup(sst_getenv("PATH"));
+            pairs = (struct snapshotPair *)(map + header->commands);
+            for(i = 0 ; i < header->commandCount ; i++)
+            {
+                  if(pairs[i].name < header->size && pairs[i].value < header->size)
+                        commandAdd(map + pairs[i].name, map + pairs[i].value, 1);
+            }
+      }
+      shellOptions = header->options;
+      rcOptions = header->options;
+      commandTableDirty = 0;
+      return 0;
+}
+
+//Lines of an rc file that only set up state that the snapshot can hold
+int isSnapshotLine(char *line)
+{
+      return strncmp(line, "alias ", 6) == 0 || strncmp(line, "timing ", 7) == 0
+            || strncmp(line, "pipesize ", 9) == 0 || strncmp(line, "pipestat ", 9) == 0;
+}
+
+//Runs ~/.ownshrc, or restores what it did last time from the snapshot
+void loadRcFile(void)
+{
+      struct stat st;
+      FILE *fp;
+      char *line = NULL;
+      size_t size = 0;
+      ssize_t length;
+      int snapshottable = 1;
+
+      if(sst_getenv("SST_RC") != NULL)
+            rcPath = strdup(sst_getenv("SST_RC"));
+      else
+      {
+            char *home = sst_getenv("HOME") != NULL ? sst_getenv("HOME") : "";
+            rcPath = malloc(strlen(home) + 10);
+            if(!rcPath)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+            sprintf(rcPath, "%s/.ownshrc", home);
+      }
+      if(stat(rcPath, &st) < 0)
+            return;
+      if(sst_getenv("SST_NO_SNAPSHOT") == NULL && snapshotLoad(&st) == 0)
+      {
+            snapshotAllowed = 1;
+            return;
+      }
+      fp = fopen(rcPath, "r");
+      if(fp == NULL)
+      {
+            perror("sst");
+            return;
+      }
+      loadingRc = 1;
+      while((length = getline(&line, &size, fp)) >= 0)
+      {
+            char *start = line;
+            while(length > 0 && (line[length-1] == '\n' || line[length-1] == '\r'))
+                  line[--length] = '\0';
+            while(*start == ' ' || *start == '\t')
+                  start++;
+            if(*start == '\0' || *start == '#')
+                  continue;
+            if(!isSnapshotLine(start))
+                  snapshottable = 0;
+            checkForCommands(start);
+      }
+      loadingRc = 0;
+      free(line);
+      fclose(fp);
+      rcOptions = shellOptions;
+      snapshotAllowed = snapshottable && sst_getenv("SST_NO_SNAPSHOT") == NULL;
+      snapshotSave();
+}
+
+#define BATCH_ALWAYS 0 //run after ; or a newline
+#define BATCH_AND 1 //run only if the previous command succeeded
+#define BATCH_OR 2 //run only if the previous command failed
+
+struct batchCommand
+{
+      char *line;
+      int condition;
+      int background; //ends with & so it runs alongside the rest
+      int ran;
+      int status;
+      pid_t pid;
+      struct timespec start;
+      double elapsed; //milliseconds
+};
+
+int editor()
+{
+      struct sst_buffer buf;
+      int endFlag = 1; //for \q
+      int enterFlag = 0; //for \ before q
+      int c;
+      int status;
+
+      sst_buffer_init(&buf);
+      while(endFlag)
+      {
+            c = sst_getchar();
+            if(c == EOF || (enterFlag && c == 'q'))
+            {
+                  endFlag = 0;
+                  break;
+            }
+            enterFlag = 0;
+            if(c == '\\')
+            {
+                  enterFlag = 1;
+            }
+            sst_buffer_putc(&buf, c);
+      }
+      if(enterFlag) //drop the \ of the closing \q
+      {
+            buf.data[--buf.length] = '\0';
+      }
+      status = executeCommandsFromEditor(buf.data);
+      sst_buffer_free(&buf);
+      return status;
+}
+
+//Adds the text between start and end to the batch as one command, unless it is blank
+void addBatchCommand(struct batchCommand **batch, int *count, int *capacity, char *start, char *end, int condition, int background)
+{
+      while(start < end && (*start == ' ' || *start == '\t' || *start == '\r'))
+            start++;
+      while(end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+            end--;
+      if(start == end)
+            return;
+      if(*count >= *capacity)
+      {
+            *capacity *= 2;
+            *batch = realloc(*batch, sizeof(struct batchCommand) * (*capacity));
+            if(!*batch)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+      }
+      struct batchCommand *cmd = &(*batch)[*count];
+      cmd->line = malloc(end - start + 1);
+      memcpy(cmd->line, start, end - start);
+      cmd->line[end - start] = '\0';
+      cmd->condition = condition;
+      cmd->background = background;
+      cmd->ran = 0;
+      cmd->status = 0;
+      cmd->pid = 0;
+      cmd->elapsed = 0;
+      (*count)++;
+}
+
+/*
+  ls -l ; date \
+  -u && echo ok
+  sleep 1 &
+  false || echo recovered \q
+  */
+int executeCommandsFromEditor(char *buf)
+{
+      int capacity = 16, count = 0;
+      struct batchCommand *batch = malloc(sizeof(struct batchCommand) * capacity);
+      char *p, *start, *end;
+      char quote = 0;
+      int condition = BATCH_ALWAYS;
+      int next;
+
+      if(!batch)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+
+      //Parse every command up front. A \ before a newline joins the two lines.
+      for(p = buf ; *p != '\0' ; p++)
+      {
+            if(*p == '\\' && p[1] == '\n')
+            {
+                  p[0] = ' ';
+                  p[1] = ' ';
+            }
+      }
+      start = buf;
+      for(p = buf ; ; p++)
+      {
+            if(quote)
+            {
+                  if(*p == quote)
+                        quote = 0;
+                  if(*p != '\0')
+                        continue;
+            }
+            if(*p == '"' || *p == '\'')
+            {
+                  quote = *p;
+                  continue;
+            }
+            end = p;
+            if(*p == '\0' || *p == '\n' || *p == ';')
+            {
+                  next = BATCH_ALWAYS;
+            }
+            else if(*p == '&' && p[1] == '&')
+            {
+                  next = BATCH_AND;
+                  p++;
+            }
+            else if(*p == '|' && p[1] == '|')
+            {
+                  next = BATCH_OR;
+                  p++;
+            }
+            else if(*p == '&')
+            {
+                  addBatchCommand(&batch, &count, &capacity, start, end, condition, 1);
+                  condition = BATCH_ALWAYS;
+                  start = p + 1;
+                  continue;
+            }
+            else
+            {
+                  continue;
+            }
+            addBatchCommand(&batch, &count, &capacity, start, end, condition, 0);
+            condition = next;
+            start = p + 1;
+            if(*p == '\0')
+                  break;
+      }
+
+      //Run them in order, honouring && and ||
+      int i;
+      int status = 1;
+      int chainStatus = 0;
+      int pending = 0;
+      struct timespec batchStart, now;
+
+      clock_gettime(CLOCK_MONOTONIC, &batchStart);
+      for(i = 0 ; i < count && status ; i++)
+      {
+            struct batchCommand *cmd = &batch[i];
+            if((cmd->condition == BATCH_AND && chainStatus != 0) || (cmd->condition == BATCH_OR && chainStatus == 0))
+            {
+                  continue;
+            }
+            cmd->ran = 1;
+            clock_gettime(CLOCK_MONOTONIC, &cmd->start);
+            if(cmd->background)
+            {
+                  fflush(stdout);
+                  cmd->pid = sst_fork();
+                  if(cmd->pid == 0)
+                  {
+                        checkForCommands(strdup(cmd->line));
+                        fflush(stdout);
+                        _exit(lastExitStatus);
+                  }
+                  else if(cmd->pid < 0)
+                  {
+                        perror("sst");
+                        cmd->ran = 0;
+                  }
+                  else
+                  {
+                        pending++;
+                  }
+                  continue;
+            }
+            lastExitStatus = 0;
+            char *copy = strdup(cmd->line); //the tokenizer writes into its input
+            status = checkForCommands(copy);
+            free(copy);
+            traceFlushDue();
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            cmd->elapsed = sst_elapsed_ms(&cmd->start, &now);
+            cmd->status = lastExitStatus;
+            chainStatus = lastExitStatus;
+      }
+
+      //Collect the commands that ran alongside the others
+      while(pending > 0)
+      {
+            int wstatus;
+            pid_t pid = waitpid(-1, &wstatus, 0);
+            if(pid < 0)
+            {
+                  if(errno == EINTR)
+                        continue;
+                  break;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            jobFinished(pid, wstatus); //a job started before the batch may end first
+            for(i = 0 ; i < count ; i++)
+            {
+                  if(batch[i].ran && batch[i].background && batch[i].pid == pid)
+                  {
+                        batch[i].elapsed = sst_elapsed_ms(&batch[i].start, &now);
+                        if(WIFEXITED(wstatus))
+                              batch[i].status = WEXITSTATUS(wstatus);
+                        else
+                              batch[i].status = 128 + WTERMSIG(wstatus);
+                        pending--;
+                        break;
+                  }
+            }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &now);
+
+      printf("---- batch summary ----\n");
+      printf("  #  status   time(ms)  command\n");
+      for(i = 0 ; i < count ; i++)
+      {
+            if(batch[i].ran)
+                  printf("%3d  %-6d %10.2f  %s%s\n", i + 1, batch[i].status, batch[i].elapsed, batch[i].line, batch[i].background ? " &" : "");
+            else
+                  printf("%3d  %-6s %10s  %s\n", i + 1, "skip", "-", batch[i].line);
+            free(batch[i].line);
+      }
+      printf("total %.2f ms\n", sst_elapsed_ms(&batchStart, &now));
+      free(batch);
+      return status;
+}
+
+void cat2Function(char *line)
+{
+      char **tokens = sst_split_line(line, ">");
+      char *outputFileName = tokens[1];
+      int fd;
+
+      if(outputFileName != NULL)
+      {
+            outputFileName = strtok(outputFileName," ");
+      }
+      redirectionGreaterThan = 0;
+      if(outputFileName == NULL)
+      {
+            fprintf(stderr, "sst: expected output file for \"cat2\"\n");
+            free(tokens);
+            return;
+      }
+
+      int endFlag = 1;
+      int enterFlag = 0;
+      int c;
+      struct sst_buffer buf;
+
+      //still consume the text up to \q on failure so it is not run as commands
+      fd = open(outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(fd < 0)
+      {
+            perror("sst");
+      }
+      sst_buffer_init(&buf);
+
+      while(endFlag)
+      {
+            c = sst_getchar();
+            if(c == EOF || (enterFlag && c == 'q'))
+            {
+                  endFlag = 0;
+                  break;
+            }
+            else if(enterFlag == 1)
+            {
+                  enterFlag = 0;
+                  sst_buffer_putc(&buf, '\\');
+            }
+            if(c == '\\')
+            {
+                  enterFlag = 1;
+            }
+            else
+            {
+                  sst_buffer_putc(&buf, c);
+            }
+            if(buf.length >= SST_STREAM_BUFSIZE) //flush in large writes
+            {
+                  if(fd >= 0 && sst_buffer_flush(&buf, fd) < 0)
+                  {
+                        perror("sst");
+                        close(fd);
+                        fd = -1;
+                  }
+                  buf.length = 0;
+            }
+      }
+      if(fd >= 0)
+      {
+            if(sst_buffer_flush(&buf, fd) < 0)
+            {
+                  perror("sst");
+            }
+            close(fd);
+      }
+      sst_buffer_free(&buf);
+      free(tokens);
+}
+
+void checkIFSyntax(char *line)
+{
+  
+      char **tokens=sst_split_line(line," ");
+      int i = 0;
+      int elseCount=0;
+      while(tokens[i+1] != NULL)
+      {
+            if(strcmp(tokens[i],"else") == 0)
+            elseCount++;
+            i++;
+      }
+      if(strcmp(tokens[i],"fi") == 0 && elseCount <=1)
+      {
+            printf("Valid Input\n");
+      }
+      else
+      {
+            printf("Syntax Error\n");
+      }
+}
+
+/*
+  Directory scanning shared by ls -z, ls -itime and file name completion.
+  The entries are read with getdents64 in 64 KiB batches into one growable
+  array; names are kept together in a single buffer and items refer to
+  them by offset.
+*/
+struct dirItem
+{
+      size_t name; //offset in dirListing.names
+      unsigned char type; //DT_REG, DT_DIR, ... or DT_UNKNOWN
+      ino_t inode;
+};
+
+struct dirListing
+{
+      struct dirItem *items;
+      int count;
+      int capacity;
+      struct sst_buffer names;
+};
+
+struct linuxDirent64
+{
+      uint64_t d_ino;
+      int64_t d_off;
+      unsigned short d_reclen;
+      unsigned char d_type;
+      char d_name[];
+};
+
+#define DIR_ITEM_NAME(listing, i) ((listing)->names.data + (listing)->items[i].name)
+
+void dirListingFree(struct dirListing *listing)
+{
+      free(listing->items);
+      sst_buffer_free(&listing->names);
+      listing->items = NULL;
+      listing->count = listing->capacity = 0;
+}
+
+//Lists path into listing. Returns an fd for the directory, for fstatat on
+//its entries, which the caller closes; -1 if it cannot be read.
+int scanDirectory(const char *path, struct dirListing *listing)
+{
+      char data[SST_STREAM_BUFSIZE];
+      int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      long n, offset;
+
+      listing->items = NULL;
+      listing->count = listing->capacity = 0;
+      sst_buffer_init(&listing->names);
+      if(fd < 0)
+            return -1;
+      while((n = syscall(SYS_getdents64, fd, data, sizeof(data))) > 0)
+      {
+            for(offset = 0 ; offset < n ; )
+            {
+                  struct linuxDirent64 *entry = (struct linuxDirent64 *)(data + offset);
+                  offset += entry->d_reclen;
+                  if(listing->count >= listing->capacity)
+                  {
+                        listing->capacity = listing->capacity ? listing->capacity * 2 : 64;
+                        listing->items = realloc(listing->items, sizeof(struct dirItem) * listing->capacity);
+                        if(!listing->items)
+                        {
+                              fprintf(stderr, "sst: allocation error\n");
+                              exit(EXIT_FAILURE);
+                        }
+                  }
+                  struct dirItem *item = &listing->items[listing->count++];
+                  item->name = listing->names.length;
+                  item->type = entry->d_type;
+                  item->inode = entry->d_ino;
+                  sst_buffer_append(&listing->names, entry->d_name, strlen(entry->d_name) + 1);
+                  shellCounters.dirEntries++;
+            }
+      }
+      if(n < 0)
+      {
+            dirListingFree(listing);
+            close(fd);
+            return -1;
+      }
+      return fd;
+}
+
+void printZeroSizeFiles()
+{
+      struct dirListing listing;
+      struct stat statbuf;
+      int i;
+      int fd = scanDirectory(".", &listing); //the current directory
+      if(fd < 0)
+      {
+            printf("Error\n");
+            return;
+      }
+      for(i = 0 ; i < listing.count ; i++) //Traverse the directory
+      {
+            char *name = DIR_ITEM_NAME(&listing, i);
+            if(listing.items[i].type != DT_REG && listing.items[i].type != DT_LNK && listing.items[i].type != DT_UNKNOWN)
+            {
+                  continue; //no need to stat directories, pipes and devices
+            }
+            if(fstatat(fd, name, &statbuf, 0) < 0) //gets inode structure for the file
+            {
+                  continue;
+            }
+            if(S_ISREG(statbuf.st_mode) && statbuf.st_size == 0) //checking for empty regular files
+            {
+                  printf("%s\t%ld\n",name,statbuf.st_size);
+            }
+      }
+      close(fd);
+      dirListingFree(&listing);
+}
+struct fileInfo
+{
+      char *name;
+      time_t mtime; //storing inode modification time
+      int order; //position in the directory, so equal times keep it
+};
+
+int compareInodeTime(const void *a, const void *b)
+{
+      const struct fileInfo *x = a, *y = b;
+      if(x->mtime != y->mtime)
+            return x->mtime < y->mtime ? -1 : 1;
+      return x->order - y->order;
+}
+
+void sortWithINodeTime()
+{
+      struct dirListing listing;
+      struct stat statbuf;
+      struct fileInfo *displayInfo;
+      int i, j = 0;
+      char str[36];
+      int fd = scanDirectory(".", &listing);
+      if(fd < 0)
+      {
+            printf("Error\n");
+            return;
+      }
+      displayInfo = malloc(sizeof(struct fileInfo) * (listing.count + 1));
+      if(!displayInfo)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      for(i = 0 ; i < listing.count ; i++)
+      {
+            displayInfo[j].name = DIR_ITEM_NAME(&listing, i);
+            if(fstatat(fd, displayInfo[j].name, &statbuf, 0) < 0)
+                  continue;
+            displayInfo[j].mtime = statbuf.st_ctime; //ctime in stat structure gives inode modification time
+            displayInfo[j].order = j;
+            j++;
+      }
+      qsort(displayInfo, j, sizeof(struct fileInfo), compareInodeTime); //Sort according to mtime
+
+      //print
+      for(i = 0 ; i < j ; i++)
+      {
+            strftime(str, sizeof(str), "%d.%m.%Y %H:%M:%S", localtime(& displayInfo[i].mtime));
+            printf("%s\t%s\n",displayInfo[i].name,str);
+      }
+      free(displayInfo);
+      close(fd);
+      dirListingFree(&listing);
+}
+
+
+void pipeInputOutput(char *line)
+{
+
+      int i = 0;
+      int flagLessThan = 0;
+      int flagGreaterThan = 0;
+      while(line != NULL)
+      {
+            if(line[i] == '<') //Input File
+            {
+                  flagLessThan = 1;
+                  break;
+            }
+            if(line[i] == '>') //Output File
+            {
+                  flagGreaterThan = 1;
+                  break;
+            }
+            i++;
+      }
+      char *inputFile, *outputFile, *commands;
+      if(flagGreaterThan)
+      {
+            char **token = sst_split_line(line,"<");
+            token[1]=strtok(token[1]," "); //name of the input file file
+            char **tokenAgain = sst_split_line(token[0],">"); 
+            tokenAgain[1] = strtok(tokenAgain[1]," "); //name of the output file 
+            inputFile = token[1];
+            outputFile = tokenAgain[1];
+            commands = token[0];
+      }
+      else
+      {
+            char **token = sst_split_line(line,">"); 
+            token[1]=strtok(token[1]," "); //name of the output File
+            char **tokenAgain = sst_split_line(token[0],"<");
+            tokenAgain[1] = strtok(tokenAgain[1]," "); //name of the input File
+            inputFile = tokenAgain[1];
+            outputFile = token[1];
+            commands = token[0];
+      }
+
+      redirectionLessThan = 0;
+      redirectionGreaterThan = 0;
+
+      //The pipeline is started straight from the shell so every stage is waited for here
+      int fd0,fd1;
+      fd0=open(unprotectWord(inputFile), O_RDONLY);
+      if(fd0 < 0)
+      {
+            perror("sst");
+            lastExitStatus = 1;
+            return;
+      }
+      fd1 = creat(unprotectWord(outputFile),0644); //create the output File
+      if(fd1 < 0)
+      {
+            perror("sst");
+            close(fd0);
+            lastExitStatus = 1;
+            return;
+      }
+      char **token1=sst_split_line(commands,"|");
+      parsePipedInput(token1, fd0, fd1); //execute the piping commands
+      sst_count_redirected(fd0);
+      sst_count_redirected(fd1);
+      close(fd0);
+      close(fd1);
+}
+
+void pipeAndOutput(char * line)
+{
+      char **token = sst_split_line(line,">"); 
+      token[1]=strtok(token[1]," "); //gets the output file
+      redirectionGreaterThan = 0;
+      int fd;
+      fd = creat(unprotectWord(token[1]),0644); //open the output file
+      if(fd < 0)
+      {
+            perror("sst");
+            lastExitStatus = 1;
+            return;
+      }
+      char **args = sst_split_line(token[0],"|");
+      parsePipedInput(args, -1, fd);
+      sst_count_redirected(fd);
+      close(fd);
+}
+
+void pipeAndInput(char * line)
+{
+      char **token = sst_split_line(line,"<"); 
+      token[1]=strtok(token[1]," "); //gets input file name
+      redirectionLessThan = 0;
+      
+      int fd0;
+      fd0=open(unprotectWord(token[1]), O_RDONLY); //Open the file that becomes the first stage's stdin
+      if(fd0 < 0)
+      {
+            perror("sst");
+            lastExitStatus = 1;
+            return;
+      }
+      char **token1=sst_split_line(token[0],"|");
+      parsePipedInput(token1, fd0, -1);
+      sst_count_redirected(fd0);
+      close(fd0);
+}
+
+void onlyRedirection(char *line)
+{
+      int i = 0;
+      int flagLessThan = 0;
+      int flagGreaterThan = 0;
+      while(line != NULL)
       {
-            aliasFunc(copyLine);
-            status = 1;
+            if(line[i] == '<')
+            {
+                  flagLessThan = 1;
+                  break;
+            }
+            if(line[i] == '>')
+            {
+                  flagGreaterThan = 1;
+                  break;
+            }
+            i++;
       }
-      else if(strcmp(copyLine,"shell editor")==0)
+
+      char *stages[2];
+      char *inputFile, *outputFile;
+      if(flagGreaterThan)
       {
-            editor();
-            status = 1;
+            char **token = sst_split_line(line,"<");
+            token[1]=strtok(token[1]," "); //gets input flag
+            char **tokenAgain = sst_split_line(token[0],">");
+            tokenAgain[1] = strtok(tokenAgain[1]," "); //gives output file
+            inputFile = token[1];
+            outputFile = tokenAgain[1];
+            stages[0] = token[0];
       }
-      else if(strncmp(copyLine,"cat2",4) == 0)
+      else
       {
-            cat2Function(copyLine);
-            status = 1;
+            char **token = sst_split_line(line,">");
+            token[1]=strtok(token[1]," "); //gets output file 
+            char **tokenAgain = sst_split_line(token[0],"<");
+            tokenAgain[1] = strtok(tokenAgain[1]," "); //gets input file
+            inputFile = tokenAgain[1];
+            outputFile = token[1];
+            stages[0] = token[0];
       }
-      else if(strncmp(copyLine,"if",2)==0)
+      stages[1] = NULL;
+      redirectionLessThan = 0;
+      redirectionGreaterThan = 0;
+
+      int fd0,fd1;
+      fd0=open(unprotectWord(inputFile), O_RDONLY); 
+      if(fd0 < 0)
       {
-            checkIFSyntax(copyLine);
-            status = 1;
+            perror("sst");
+            lastExitStatus = 1;
+            return;
       }
-      else if(strcmp(copyLine,"ls -z") == 0)
+      fd1 = creat(unprotectWord(outputFile),0644); //create the output file
+      if(fd1 < 0)
       {
-            printZeroSizeFiles();
-            status = 1;
+            perror("sst");
+            close(fd0);
+            lastExitStatus = 1;
+            return;
       }
-      else if(strcmp(copyLine, "ls -itime") == 0)
+      parsePipedInput(stages, fd0, fd1); //a single stage pipeline
+      sst_count_redirected(fd0);
+      sst_count_redirected(fd1);
+      close(fd0);
+      close(fd1);
+}
+
+void readFromInputFile(char *line)
+{
+      char **token = sst_split_line(line,"<");
+      token[1]=strtok(token[1]," "); //gives input file name
+      redirectionLessThan = 0;
+      int fd0;
+      fd0=open(unprotectWord(token[1]), O_RDONLY); //opens the input file
+      if(fd0 < 0)
       {
-            sortWithINodeTime();
-            status = 1;
+            perror("sst");
+            lastExitStatus = 1;
+            return;
       }
-      else 
+      char *stages[] = {token[0], NULL};
+      parsePipedInput(stages, fd0, -1);
+      sst_count_redirected(fd0);
+      close(fd0);
+}
+
+void readFromOutputFile(char *line)
+{
+      char **token = sst_split_line(line,">");
+      token[1]=strtok(token[1]," "); //gets output file name
+      redirectionGreaterThan = 0;
+      int fd0;
+      fd0 = creat(unprotectWord(token[1]),0644);
+      if(fd0 < 0)
       {
-            char *check = malloc(sizeof(char)*strlen(line));
-            check = checkAlias(line);
-            if(check != NULL)
-            {
-                  args = sst_split_line(check," \t\r\n\a");
-            }
+            perror("sst");
+            lastExitStatus = 1;
+            return;
+      }
+      char *stages[] = {token[0], NULL};
+      parsePipedInput(stages, -1, fd0);
+      sst_count_redirected(fd0);
+      close(fd0);
+}
+
+
+/*
+  Pipe tuning. "pipesize <bytes>" raises the capacity of the pipes between
+  pipeline stages with F_SETPIPE_SZ, capped at /proc/sys/fs/pipe-max-size,
+  so high volume pipelines switch between stages less often. "pipestat on"
+  samples every stage's /proc/<pid>/stat and /proc/<pid>/syscall each
+  millisecond while a pipeline runs and reports how much of the time each
+  stage was running, blocked reading its input or blocked writing its
+  output, plus its run and run-queue time from schedstat. The stage that
+  keeps running while its neighbours wait on the pipes is the bottleneck.
+*/
+#define PIPESTAT_INTERVAL_NS 1000000
+
+struct stageSample
+{
+      long running; //on a CPU or waiting for one
+      long reading; //asleep in read() on stdin
+      long writing; //asleep in write() on stdout
+      long other; //any other sleep
+      long samples;
+      unsigned long long runNs; //from /proc/<pid>/schedstat
+      unsigned long long queueNs;
+      int done;
+};
+
+long pipeMaxSize(void)
+{
+      FILE *fp = fopen("/proc/sys/fs/pipe-max-size", "r");
+      long size = 1048576;
+
+      if(fp != NULL)
+      {
+            if(fscanf(fp, "%ld", &size) != 1)
+                  size = 1048576;
+            fclose(fp);
+      }
+      return size;
+}
+
+int sst_pipesize(char **args)
+{
+      char *unit;
+      long size, max = pipeMaxSize();
+
+      if (args[1] == NULL)
+      {
+            if (shellOptions.pipeSize > 0)
+                  printf("pipe size %ld bytes (max %ld)\n", shellOptions.pipeSize, max);
             else
+                  printf("pipe size default (max %ld)\n", max);
+            return 1;
+      }
+      if (strcmp(args[1], "default") == 0)
+      {
+            shellOptions.pipeSize = 0;
+            return 1;
+      }
+      size = strtol(args[1], &unit, 10);
+      if (*unit == 'K' || *unit == 'k')
+            size <<= 10;
+      else if (*unit == 'M' || *unit == 'm')
+            size <<= 20;
+      else if (*unit != '\0')
+            size = -1;
+      if (size <= 0)
+      {
+            fprintf(stderr, "sst: usage: pipesize [<bytes>[K|M]|default]\n");
+            return 1;
+      }
+      if (size > max)
+      {
+            fprintf(stderr, "sst: pipe size capped at %ld bytes (/proc/sys/fs/pipe-max-size)\n", max);
+            size = max;
+      }
+      shellOptions.pipeSize = size;
+      return 1;
+}
+
+int sst_pipestat(char **args)
+{
+      if (args[1] == NULL)
+            printf("pipestat is %s\n", shellOptions.pipeStats ? "on" : "off");
+      else if (strcmp(args[1], "on") == 0)
+            shellOptions.pipeStats = 1;
+      else if (strcmp(args[1], "off") == 0)
+            shellOptions.pipeStats = 0;
+      else
+            fprintf(stderr, "sst: usage: pipestat [on|off]\n");
+      return 1;
+}
+
+//Reads a small /proc file into text. Returns -1 if it is gone.
+int readProcFile(pid_t pid, char *name, char *text, int size)
+{
+      char path[64];
+      int fd, n;
+
+      snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+      fd = open(path, O_RDONLY | O_CLOEXEC);
+      if(fd < 0)
+            return -1;
+      n = read(fd, text, size - 1);
+      close(fd);
+      if(n <= 0)
+            return -1;
+      text[n] = '\0';
+      return n;
+}
+
+//Records what a stage is doing right now. Returns 0 once it has exited.
+int stageSampleOnce(pid_t pid, struct stageSample *sample)
+{
+      char text[512], *end, state;
+      long number;
+      unsigned long fd;
+
+      if(readProcFile(pid, "stat", text, sizeof(text)) < 0 || (end = strrchr(text, ')')) == NULL)
+            return 0;
+      state = end[2]; //"pid (comm) state ..."
+      if(state == 'Z' || state == 'X')
+            return 0;
+      if(readProcFile(pid, "schedstat", text, sizeof(text)) > 0)
+            sscanf(text, "%llu %llu", &sample->runNs, &sample->queueNs);
+      sample->samples++;
+      if(state == 'R')
+      {
+            sample->running++;
+            return 1;
+      }
+      if(readProcFile(pid, "syscall", text, sizeof(text)) > 0 && sscanf(text, "%ld %lx", &number, &fd) == 2)
+      {
+            if((number == SYS_read || number == SYS_readv) && fd == STDIN_FILENO)
             {
-                  args = sst_split_line(line," \t\r\n\a");
+                  sample->reading++;
+                  return 1;
             }
-            if(redirectionGreaterThan == 1 && redirectionLessThan == 1 && pipeInInputFlag == 1)
+            if((number == SYS_write || number == SYS_writev) && fd == STDOUT_FILENO)
             {
-                  pipeInputOutput(copyLine);
+                  sample->writing++;
+                  return 1;
             }
-            else if(redirectionGreaterThan == 1 && pipeInInputFlag == 1)
+      }
+      sample->other++;
+      return 1;
+}
+
+//Samples the stages until all of them have exited (or the deadline passes)
+void pipelineMeasure(pid_t *pids, int count, struct stageSample *samples)
+{
+      struct timespec interval = {0, PIPESTAT_INTERVAL_NS};
+      int i, alive;
+
+      do
+      {
+            alive = 0;
+            for(i = 0 ; i < count ; i++)
             {
-                  pipeAndOutput(copyLine);
+                  if(!samples[i].done && !stageSampleOnce(pids[i], &samples[i]))
+                        samples[i].done = 1;
+                  alive += !samples[i].done;
             }
-            else if(redirectionLessThan == 1 && pipeInInputFlag == 1)
+            if(currentStats.hasDeadline && sst_deadline_remaining() == 0)
+                  break; //sst_wait kills the pipeline
+      }while(alive > 0 && nanosleep(&interval, NULL) == 0);
+}
+
+void pipelineReport(char **token, pid_t *pids, int count, struct stageSample *samples)
+{
+      int i, bottleneck = 0;
+      double busy, mostBusy = -1;
+
+      fprintf(stderr, "stage pid      run%%  read%%  write%%  other%%  cpu(ms)  runq(ms)  command\n");
+      for(i = 0 ; i < count ; i++)
+      {
+            struct stageSample *s = &samples[i];
+            double total = s->samples > 0 ? s->samples : 1;
+            char *command = token[i];
+            while(*command == ' ')
+                  command++;
+            fprintf(stderr, "%-5d %-7d %5.1f  %5.1f  %6.1f  %6.1f  %7.2f  %8.2f  %s\n", i + 1, (int)pids[i],
+                  100 * s->running / total, 100 * s->reading / total, 100 * s->writing / total, 100 * s->other / total,
+                  s->runNs / 1e6, s->queueNs / 1e6, command);
+            busy = (s->running + s->other) / total;
+            if(busy > mostBusy)
             {
-                  pipeAndInput(copyLine);
+                  mostBusy = busy;
+                  bottleneck = i;
             }
-            else if(redirectionLessThan == 1 && redirectionGreaterThan == 1)
+      }
+      if(count > 1)
+      {
+            char *command = token[bottleneck];
+            while(*command == ' ')
+                  command++;
+            fprintf(stderr, "bottleneck: stage %d (%s)\n", bottleneck + 1, command);
+      }
+}
+
+//Runs token[0] | token[1] | ... with one process per stage. inFd and outFd
+//replace the stdin of the first stage and the stdout of the last one when
+//they are not -1, and a stage with a here-document reads its body instead.
+void parsePipedInput(char **token, int inFd, int outFd)
+{
+      int i, count = 0, started;
+      pipeInInputFlag = 0;
+      int pipefd[2]; 
+      int prevFd = inFd; //read end feeding the next stage
+      int stageIn;
+      pid_t *pids;
+      char **envp = sst_environ();
+
+      while(token[count] != NULL)
+      {
+            count++;
+      }
+      pids = malloc(sizeof(pid_t) * (count + 1));
+      if(!pids)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+      for(i = 0 ; i < count ; i++)
+      {
+            pipefd[0] = pipefd[1] = -1;
+            if (i < count - 1 && pipe(pipefd) < 0) 
             {
-                  onlyRedirection(copyLine);
+                  printf("\nPipe could not be initialized");
+                  break;
             }
-            else if(redirectionLessThan == 1)
+            if (pipefd[1] >= 0 && shellOptions.pipeSize > 0)
             {
-                  readFromInputFile(copyLine);
+                  fcntl(pipefd[1], F_SETPIPE_SZ, (int)shellOptions.pipeSize); //best effort, may exceed the user's pipe quota
             }
-            else if(redirectionGreaterThan == 1)
+            stageIn = i < heredocStageCount && heredocStageFds[i] >= 0 ? heredocStageFds[i] : prevFd; //a here-document replaces the stage's input
+            pids[i] = -1;
+            if(zygoteFd >= 0)
             {
-                  readFromOutputFile(copyLine);
+                  char *copy = strdup(token[i]); //token[i] is kept for the stage report
+                  char **args = sst_split_line(copy, " ");
+                  unprotectArgs(args);
+                  pids[i] = zygoteSpawn(args, stageIn, i < count - 1 ? pipefd[1] : outFd);
+                  free(args);
+                  free(copy);
             }
-            else if(pipeInInputFlag == 1)
+            if(pids[i] < 0)
+                  pids[i] = sst_fork();
+            if (pids[i] < 0) 
             {
-                  char **token;
-                  token = sst_split_line(copyLine,"|");
-                  parsePipedInput(token);
-                  status=1;
+                  printf("\nCould not fork");
+                  if(pipefd[0] >= 0)
+                  {
+                        close(pipefd[0]);
+                        close(pipefd[1]);
+                  }
+                  break;
             }
-            else
+            if (pids[i] == 0) 
             {
-                  int index = 0;
-                  while(copyLine[index] != '\0')
+                  if(stageIn >= 0)
                   {
-                        if(copyLine[index] == '*')
-                        {
-                              starFlag = 1;
-                              break;
-                        }
-                        index++;
+                        dup2(stageIn, STDIN_FILENO); //read from the previous stage
+                        close(stageIn);
                   }
-                  if(starFlag != 1)
+                  if(prevFd >= 0 && prevFd != stageIn)
+                        close(prevFd);
+                  if(i < count - 1)
                   {
-                        status = sst_execute(args);
+                        close(pipefd[0]);
+                        dup2(pipefd[1], STDOUT_FILENO); //write to the next stage
+                        close(pipefd[1]);
                   }
-                  else
+                  else if(outFd >= 0)
                   {
-                        char **tokens = sst_split_line(copyLine, " ");
-                        char *regex = tokens[1];
-                        printFilesWithRegex(regex);
-                        starFlag = 0;
-                        status = 1;
+                        dup2(outFd, STDOUT_FILENO);
                   }
-            }     
+                  if(inFd >= 0 && inFd != prevFd)
+                        close(inFd);
+                  if(outFd >= 0)
+                        close(outFd);
+                  char **args = sst_split_line(token[i], " ");
+                  unprotectArgs(args);
+                  if (args[0] == NULL || sst_exec(NULL, args, envp) < 0) 
+                  {
+                        printf("\nCould not execute command..\n");
+                  }
+                  exit(127);
+            } 
+            if(prevFd >= 0 && prevFd != inFd)
+                  close(prevFd);
+            if(i < count - 1)
+            {
+                  close(pipefd[1]);
+                  prevFd = pipefd[0];
+            }
       }
-      return status;
+      started = i;
+      if(prevFd >= 0 && prevFd != inFd)
+            close(prevFd);
+      if(shellOptions.pipeStats && started > 0)
+      {
+            struct stageSample *samples = calloc(started, sizeof(struct stageSample));
+            if(!samples)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+            pipelineMeasure(pids, started, samples);
+            for(i = 0 ; i < started ; i++)
+            {
+                  sst_wait(pids[i], token[i]);
+            }
+            pipelineReport(token, pids, started, samples);
+            free(samples);
+            free(pids);
+            return;
+      }
+      for(i = 0 ; i < started ; i++)
+      {
+            sst_wait(pids[i], token[i]); //the last stage's status is the pipeline's
+      }
+      free(pids);
 }
 
-struct node* newNode(char *data)
+void printFilesWithRegex(char *regex)
 {
-      struct node *temp = malloc(sizeof(struct node));
-      temp -> data = (char*)malloc(sizeof(char)*strlen(data));
-      strcpy(temp->data, data);
-      temp -> prev = NULL;
-      temp -> next = NULL;
-      return temp;
+  
+      wordexp_t p;
+      char **w;
+      size_t i;
+      wordexp(regex, &p, 0);
+      w = p.we_wordv;
+      shellCounters.globMatches += p.we_wordc;
+      for (i = 0; i < p.we_wordc; i++)
+      {
+            printf("%s\n", w[i]);
+      }
+      wordfree(&p);
+}
+
+/*
+  Input layer. The event loop reads whatever the terminal or pipe has with
+  one read() and keeps it here; sst_read_line and the editors take their
+  characters from this buffer so nothing read ahead is lost. The buffer
+  grows when a single line does not fit.
+*/
+struct sst_input
+{
+      char *data;
+      size_t capacity;
+      size_t start;
+      size_t end;
+      int eof;
+} sstInput;
+
+//Makes room for n more bytes after the unread input
+void sst_input_reserve(size_t n)
+{
+      if(sstInput.start == sstInput.end)
+      {
+            sstInput.start = 0;
+            sstInput.end = 0;
+      }
+      if(sstInput.end + n <= sstInput.capacity)
+            return;
+      if(sstInput.start > 0)
+      {
+            memmove(sstInput.data, sstInput.data + sstInput.start, sstInput.end - sstInput.start);
+            sstInput.end -= sstInput.start;
+            sstInput.start = 0;
+      }
+      if(sstInput.end + n <= sstInput.capacity)
+            return;
+      if(sstInput.capacity == 0)
+            sstInput.capacity = SST_INPUT_BUFSIZE;
+      while(sstInput.end + n > sstInput.capacity)
+            sstInput.capacity *= 2;
+      sstInput.data = realloc(sstInput.data, sstInput.capacity);
+      if(!sstInput.data)
+      {
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
+      }
+}
+
+//Reads more input once. Returns the number of bytes read, 0 at end of input.
+int sst_fill_input(void)
+{
+      ssize_t n;
+
+      sst_input_reserve(1); //a full buffer would make read() return 0
+      do
+      {
+            n = read(STDIN_FILENO, sstInput.data + sstInput.end, sstInput.capacity - sstInput.end);
+      }while(n < 0 && errno == EINTR);
+      if(n <= 0)
+      {
+            sstInput.eof = 1;
+            return 0;
+      }
+      sstInput.end += n;
+      return n;
+}
+
+int sst_getchar(void)
+{
+      if(sstInput.start == sstInput.end && (sstInput.eof || sst_fill_input() == 0))
+            return EOF;
+      return (unsigned char)sstInput.data[sstInput.start++];
 }
 
-void historyPrint()
+//True when sst_read_line can return without blocking
+int sst_input_has_line(void)
 {
-      int i;
-      struct node *temp = head;
-      while(temp != NULL)
+      if(sstInput.start == sstInput.end)
+            return 0;
+      return sstInput.eof || memchr(sstInput.data + sstInput.start, '\n', sstInput.end - sstInput.start) != NULL;
+}
+
+/*
+  Here-documents and here-strings. "cmd <<EOF" takes the lines up to EOF
+  as the command's stdin and "cmd <<< word" takes word and a newline. The
+  body is collected before the command runs and given to the pipeline stage
+  it is written on, on fd 0 for the length of a single command: through a
+  pipe the shell fills by itself when it fits in the pipe, otherwise through
+  a sealed memfd, so nothing is written to disk.
+  Body lines are expanded as on a command line unless the delimiter is
+  quoted, and <<- strips their leading tabs.
+*/
+FILE *scriptInput = NULL; //the script runScript is reading, if any
+
+//Next line of a body: the rest of a multi-line request, the script being
+//run or the shell's own input. NULL at end of input.
+char *heredocNextLine(char **rest)
+{
+      char *line, *newline;
+      size_t size = 0;
+
+      if(*rest != NULL)
       {
-            printf("%s     %s      \n",temp->data,temp->timestamp);
-            temp = temp->next;
+            if(**rest == '\0')
+                  return NULL;
+            newline = *rest + strcspn(*rest, "\n");
+            line = strndup(*rest, newline - *rest);
+            *rest = *newline != '\0' ? newline + 1 : newline;
+            return line;
+      }
+      if(scriptInput != NULL)
+      {
+            line = NULL;
+            if(getline(&line, &size, scriptInput) < 0)
+            {
+                  free(line);
+                  return NULL;
+            }
+            line[strcspn(line, "\r\n")] = '\0';
+            return line;
       }
+      if(isatty(STDIN_FILENO))
+      {
+            printf("> ");
+            fflush(stdout);
+      }
+      if(sstInput.start == sstInput.end && (sstInput.eof || sst_fill_input() == 0))
+            return NULL;
+      return sst_read_line();
 }
 
-void aliasFunc(char * line)
+//Reads a word that may be quoted, blanking it out of the line. Returns a
+//copy without the quotes and sets quoted if it had any.
+char *heredocWord(char *p, char **end, int *quoted)
 {
-      char **token;
-      char **token1;
-      token = sst_split_line(line,"=\"");
-      token1 = sst_split_line(token[0]," ");
-      aliasArray[aliasArrayCount].originalValue = malloc(sizeof(char)*strlen(token[1]));
-      strcpy(aliasArray[aliasArrayCount]. originalValue,token[1]);
-      aliasArray[aliasArrayCount].newValue = malloc(sizeof(char)*strlen(token1[1]));
-      strcpy(aliasArray[aliasArrayCount].newValue,token1[1]);
-      aliasArrayCount++;
+      struct sst_buffer word;
+      char quote = 0;
+
+      *quoted = 0;
+      while(*p == ' ' || *p == '\t')
+            p++;
+      sst_buffer_init(&word);
+      for( ; *p != '\0' && *p != '\n' && (quote || (*p != ' ' && *p != '\t' && *p != '|' && *p != '<' && *p != '>')) ; p++)
+      {
+            if(quote && *p == quote)
+                  quote = 0;
+            else if(!quote && (*p == '"' || *p == '\''))
+                  quote = *p, *quoted = 1;
+            else
+                  sst_buffer_putc(&word, *p);
+            *p = ' ';
+      }
+      *end = p;
+      if(word.length == 0 && !*quoted)
+      {
+            sst_buffer_free(&word);
+            return NULL;
+      }
+      return word.data;
 }
 
-char* checkAlias(char *line)
+//Puts body on a new fd positioned at its start
+int heredocOpen(struct sst_buffer *body)
 {
-      int i;
-      int flag = 0;
-      for(i = 0 ; i < aliasArrayCount ; i++)
+      int fds[2], fd;
+      long capacity;
+
+      if(pipe2(fds, O_CLOEXEC) == 0)
       {
-            if(strcmp(line,aliasArray[i].newValue) == 0)
+            capacity = fcntl(fds[1], F_GETPIPE_SZ);
+            if(capacity > 0 && body->length <= (size_t)capacity) //fits, so the write cannot block
             {
-                  flag = 1;
-                  break;
+                  if(body->length > 0 && write(fds[1], body->data, body->length) != (ssize_t)body->length)
+                        perror("sst: here-document");
+                  close(fds[1]);
+                  shellCounters.heredocPipes++;
+                  return fds[0];
             }
+            close(fds[0]);
+            close(fds[1]);
       }
-      if(flag == 1)
+      fd = memfd_create("ownsh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+      if(fd < 0)
       {
-            return aliasArray[i].originalValue;
+            perror("sst: memfd_create");
+            return -1;
       }
-      else
+      if(sst_buffer_flush(body, fd) < 0)
       {
-            return NULL;
+            perror("sst: here-document");
+            close(fd);
+            return -1;
       }
+      fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL);
+      lseek(fd, 0, SEEK_SET);
+      shellCounters.heredocMemfds++;
+      return fd;
 }
 
-void editor()
+//Takes every <<, <<- and <<< out of line. The last body of a single
+//command goes on fd 0 and savedStdin gets the shell's own stdin back for
+//heredocRestore, or -1 if there was none. In a pipeline each stage's body
+//goes in heredocStageFds for parsePipedInput. Returns -1 on a syntax error.
+int heredocApply(char *line, int *savedStdin)
 {
-      int i = 0;
-      pid_t x = fork();
+      struct sst_buffer body;
+      char *p, *end, *word, *rest = NULL;
+      char quote = 0;
+      char marker[32];
+      int *stageFds = NULL;
+      int quoted, stripTabs, fd, stage = 0, stageCount = 0, error = 0, i;
 
-      if(x==0)
+      *savedStdin = -1;
+      if(strchr(line, '\n') != NULL) //a multi-line request carries its own bodies
+            rest = strchr(line, '\n') + 1;
+      if(heredocBodies.data == NULL)
+            sst_buffer_init(&heredocBodies);
+      heredocBodies.length = 0; //the bodies decide the output as much as the command does
+      sst_buffer_init(&body);
+      for(p = line ; *p != '\0' && *p != '\n' ; p++)
       {
-            char *buf = malloc(sizeof(char)*100);
-            int endFlag = 1; //for \q
-            int enterFlag = 0; //for \
-            
-            while(endFlag)
+            if(quote)
+            {
+                  if(*p == quote)
+                        quote = 0;
+                  continue;
+            }
+            if(*p == '"' || *p == '\'')
             {
-                  char c = getchar();
-                  if(enterFlag && c == 'q')
+                  quote = *p;
+                  continue;
+            }
+            if(*p == '|' && p > line && p[-1] != '|') //stages are split on runs of |
+                  stage++;
+            if(p[0] != '<' || p[1] != '<')
+                  continue;
+            body.length = 0;
+            if(p[2] == '<')
+            {
+                  memset(p, ' ', 3);
+                  word = heredocWord(p + 3, &end, &quoted);
+                  if(word == NULL)
                   {
-                        endFlag = 0;
-                        buf[i] = '\0';
-                        executeCommandsFromEditor(buf);
-                        _exit(1);
+                        error = 1;
+                        break;
                   }
-                  else
+                  unprotectWord(word);
+                  sst_buffer_append(&body, word, strlen(word));
+                  sst_buffer_putc(&body, '\n');
+            }
+            else
+            {
+                  char *text;
+                  stripTabs = p[2] == '-';
+                  memset(p, ' ', stripTabs ? 3 : 2);
+                  word = heredocWord(p + (stripTabs ? 3 : 2), &end, &quoted);
+                  if(word == NULL)
                   {
-                        enterFlag = 0;
+                        error = 1;
+                        break;
                   }
-                  if(c == '\\')
+                  while(1)
                   {
-                        enterFlag = 1;
+                        char *bodyLine = heredocNextLine(&rest);
+                        if(bodyLine == NULL)
+                        {
+                              fprintf(stderr, "sst: here-document ended by end of input (wanted \"%s\")\n", word);
+                              break;
+                        }
+                        text = bodyLine;
+                        while(stripTabs && *text == '\t')
+                              text++;
+                        if(strcmp(text, word) == 0)
+                        {
+                              free(bodyLine);
+                              break;
+                        }
+                        char *expanded = quoted ? NULL : expandLine(text);
+                        if(expanded != NULL)
+                              text = expanded;
+                        unprotectWord(text); //a body is data, not a command
+                        sst_buffer_append(&body, text, strlen(text));
+                        sst_buffer_putc(&body, '\n');
+                        free(expanded);
+                        free(bodyLine);
                   }
-                  if(c != '\n')
+            }
+            free(word);
+            p = end - 1;
+
+            snprintf(marker, sizeof(marker), "%d %zu\n", stage, body.length);
+            sst_buffer_append(&heredocBodies, marker, strlen(marker));
+            sst_buffer_append(&heredocBodies, body.data, body.length);
+            fd = heredocOpen(&body);
+            if(fd < 0)
+            {
+                  error = 2;
+                  break;
+            }
+            if(stage >= stageCount)
+            {
+                  stageFds = realloc(stageFds, sizeof(int) * (stage + 1));
+                  if(!stageFds)
                   {
-                        buf[i++] = c;
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
                   }
+                  while(stageCount <= stage)
+                        stageFds[stageCount++] = -1;
             }
+            if(stageFds[stage] >= 0) //the last one of a stage wins
+                  close(stageFds[stage]);
+            stageFds[stage] = fd;
       }
-      else
+      sst_buffer_free(&body);
+      if(strchr(line, '\n') != NULL) //the command itself ends at the first newline
+            *strchr(line, '\n') = '\0';
+      if(error)
+      {
+            if(error == 1)
+                  fprintf(stderr, "sst: syntax error: << needs a word\n");
+            for(i = 0 ; i < stageCount ; i++)
+            {
+                  if(stageFds[i] >= 0)
+                        close(stageFds[i]);
+            }
+            free(stageFds);
+            heredocBodies.length = 0;
+            return -1;
+      }
+      if(stageCount == 0)
+            return 0;
+      if(stage == 0) //a single command, builtins included, reads it from fd 0
       {
-            wait(NULL);
+            fflush(stdout);
+            *savedStdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+            dup2(stageFds[0], STDIN_FILENO); //the copy on fd 0 is not close-on-exec
+            close(stageFds[0]);
+            free(stageFds);
+            return 0;
       }
+      heredocStageFds = stageFds;
+      heredocStageCount = stageCount;
+      return 0;
 }
 
-
-/* 
-  ls \   
-  -l \q
-  */
-void executeCommandsFromEditor(char *buf)
+//Gives the shell its own stdin back after a command with a here-document
+//and closes the bodies of a pipeline's stages
+void heredocRestore(int savedStdin)
 {
-  
-      char **tokens = sst_split_line(buf, "\\");
-      int i = 1;
-      char *newBuf = malloc(sizeof(char)*100);
-      strcpy(newBuf,tokens[0]);
-      while(tokens[i] != NULL)
+      int i;
+
+      for(i = 0 ; i < heredocStageCount ; i++)
       {
-            strcat(newBuf," ");
-            strcat(newBuf,tokens[i]);
-            i++;
+            if(heredocStageFds[i] >= 0)
+                  close(heredocStageFds[i]);
       }
-      checkForCommands(newBuf);
+      free(heredocStageFds);
+      heredocStageFds = NULL;
+      heredocStageCount = 0;
+      if(heredocBodies.data != NULL)
+            heredocBodies.length = 0;
+      if(savedStdin < 0)
+            return;
+      dup2(savedStdin, STDIN_FILENO);
+      close(savedStdin);
 }
 
-void cat2Function(char *line)
+/*
+  Background jobs started with &. They are reaped when the event loop sees
+  SIGCHLD, so the notice appears as soon as the job ends.
+*/
+struct job
 {
-      char **tokens = sst_split_line(line, ">");
-      char *outputFileName = tokens[1];
-      outputFileName = strtok(outputFileName," ");
+      int id;
+      pid_t pid;
+      char *command;
+      struct timespec start;
+      char *cgroup; //its limit group, read back when it ends
+      struct job *next;
+} *jobList;
+int nextJobId = 1;
+int atPrompt = 0; //the prompt is on screen, so a notice has to redraw it
 
-      int endFlag = 1;
-      int enterFlag = 0;
-      int i=0;
+void sst_prompt(void)
+{
+      char *buf = malloc(sizeof(char) * 100);
+      size_t size = 100;
+      if(getcwd(buf,size) == NULL)
+            strcpy(buf, "?");
+      printf("%s~$ ",buf);
+      fflush(stdout);
+      free(buf);
+      atPrompt = 1;
+      editorRawMode();
+}
 
-      FILE *fptr;
+/*
+  Interactive line editing. When stdin is a terminal the shell reads it in
+  raw mode between commands and echoes the line itself, so Tab can complete
+  the word before the cursor. Finished lines are appended to sstInput and run
+  exactly like piped input; the terminal is back in normal mode while a
+  command runs. Editing is append-only: Backspace, ^U, ^C and ^D work, other
+  control keys and escape sequences are ignored.
+*/
+#define EDITOR_LINE_MAX 4096
+#define COMPLETION_LIST_MAX 200
 
-      fptr = fopen(outputFileName, "w+");
+struct lineEditor
+{
+      int enabled; //stdin is a terminal
+      int raw; //the terminal is in raw mode now
+      struct termios saved;
+      char line[EDITOR_LINE_MAX];
+      int length;
+      int escape; //inside an escape sequence
+      int lastWasTab;
+} lineEditor;
 
-      while(endFlag)
+void editorRawMode(void)
+{
+      struct termios raw;
+
+      if(!lineEditor.enabled || lineEditor.raw)
+            return;
+      if(tcgetattr(STDIN_FILENO, &lineEditor.saved) < 0)
       {
-            char c = getchar();
-            if(enterFlag && c == 'q')
-            {
-                  endFlag = 0;
-                  fclose(fptr);
-            }
-            else if(enterFlag == 1)
-            {
-                  enterFlag = 0;
-                  fprintf(fptr, "\\");
-            }
-            if(c == '\\')
-            {
-                  enterFlag = 1;
-            }
-            else
-            {
-                  fprintf(fptr,"%c",c);
-            }
+            lineEditor.enabled = 0;
+            return;
       }
+      raw = lineEditor.saved;
+      raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+      raw.c_iflag &= ~(IXON | ICRNL);
+      raw.c_cc[VMIN] = 1;
+      raw.c_cc[VTIME] = 0;
+      tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+      lineEditor.raw = 1;
 }
 
-void checkIFSyntax(char *line)
+void editorCookedMode(void)
 {
-  
-      char **tokens=sst_split_line(line," ");
-      int i = 0;
-      int elseCount=0;
-      while(tokens[i+1] != NULL)
-      {
-            if(strcmp(tokens[i],"else") == 0)
-            elseCount++;
-            i++;
-      }
-      if(strcmp(tokens[i],"fi") == 0 && elseCount <=1)
-      {
-            printf("Valid Input\n");
-      }
-      else
+      if(!lineEditor.raw)
+            return;
+      tcsetattr(STDIN_FILENO, TCSADRAIN, &lineEditor.saved);
+      lineEditor.raw = 0;
+}
+
+//Writes the part of the line typed so far, after the prompt was printed again
+void editorShowLine(void)
+{
+      if(lineEditor.enabled && lineEditor.length > 0)
       {
-            printf("Syntax Error\n");
+            fwrite(lineEditor.line, 1, lineEditor.length, stdout);
+            fflush(stdout);
       }
 }
 
-void printZeroSizeFiles()
+void editorInsert(const char *text, int length)
 {
-      char *buf = malloc(sizeof(char) * 100);
-      size_t size = 100;
-      if(getcwd(buf, size) == NULL) //gives cwd
+      if(lineEditor.length + length >= EDITOR_LINE_MAX)
       {
-            printf("Error\n");
+            putchar('\a');
             return;
       }
-      struct stat statbuf;
-      struct dirent *dirp;
-      DIR *dp; 
-      dp = opendir(buf); //open the directory that getcwd gave
-      if(dp == NULL)
+      memcpy(lineEditor.line + lineEditor.length, text, length);
+      lineEditor.length += length;
+      fwrite(text, 1, length, stdout);
+}
+
+/*
+  Programs in PATH for completion, kept in a first-child/next-sibling trie.
+  It is built on the first Tab that completes a command name, with one
+  getdents pass per PATH directory and no per-file system calls for regular
+  files and links. Later Tabs only stat the directories and rescan those
+  whose mtime changed. A name's count is the number of
+  PATH directories that have it, so a rescan can take one directory's
+  programs out without losing the same name from another one.
+*/
+struct trieNode
+{
+      char c;
+      int count;
+      struct trieNode *child;
+      struct trieNode *sibling;
+};
+
+struct pathDirectory
+{
+      char *path;
+      struct timespec mtime;
+      dev_t device;
+      ino_t inode;
+      int scanned;
+      struct dirListing programs;
+};
+
+#define TRIE_BLOCK_NODES 4096
+
+struct trieNode pathTrie;
+struct pathDirectory *pathDirectories = NULL;
+int pathDirectoryCount = 0;
+char *pathTriePath = NULL; //PATH the trie was built from
+
+//Nodes are handed out from blocks, since a PATH has tens of thousands of them
+struct trieNode *trieNodeAlloc(void)
+{
+      static struct trieNode *block = NULL;
+      static int used = TRIE_BLOCK_NODES;
+
+      if(used == TRIE_BLOCK_NODES)
       {
-            printf("Error\n");
-            return;
+            block = calloc(TRIE_BLOCK_NODES, sizeof(struct trieNode));
+            if(!block)
+            {
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
+            }
+            used = 0;
       }
-      else
+      return &block[used++];
+}
+
+void trieAdd(struct trieNode *node, const char *name, int delta)
+{
+      for( ; *name != '\0' ; name++)
       {
-            while((dirp = readdir(dp)) != NULL) //Traverse the directory
+            struct trieNode **link = &node->child;
+            while(*link != NULL && (*link)->c != *name)
+                  link = &(*link)->sibling;
+            if(*link == NULL)
             {
-                  char *path = malloc(sizeof(char)*100);
-                  strcpy(path,buf);
-                  strcat(path,"/");
-                  strcat(path,dirp->d_name); //storing the path of the file
-                  stat(path, &statbuf); //gets inode structure for the file
-                  if(S_ISREG(statbuf.st_mode)) //checking for regular file
-                  {
-                        if(statbuf.st_size == 0) //checking for empty files
-                        {
-                              printf("%s\t%ld\n",dirp->d_name,statbuf.st_size);
-                        } 
-                  }
+                  if(delta < 0)
+                        return;
+                  *link = trieNodeAlloc();
+                  (*link)->c = *name;
             }
+            node = *link;
       }
+      node->count += delta;
 }
 
-struct fileInfo
+struct trieNode *trieFind(struct trieNode *node, const char *prefix)
 {
-      char *name;
-      time_t mtime; //storing inode modification time
-};
+      for( ; *prefix != '\0' && node != NULL ; prefix++)
+      {
+            node = node->child;
+            while(node != NULL && node->c != *prefix)
+                  node = node->sibling;
+      }
+      return node;
+}
 
-void sortWithINodeTime()
+void pathDirectoryDrop(struct pathDirectory *dir)
 {
-      struct fileInfo *displayInfo = malloc(sizeof(struct fileInfo)*100);
-      int i = 0;
-      char *buf = malloc(sizeof(char) * 100);
-      size_t size = 100;
-      if(getcwd(buf, size) == NULL)
-      {
-            printf("Error\n");
+      int i;
+
+      for(i = 0 ; i < dir->programs.count ; i++)
+            trieAdd(&pathTrie, DIR_ITEM_NAME(&dir->programs, i), -1);
+      dirListingFree(&dir->programs);
+      dir->scanned = 0;
+}
+
+//Reads the executables of one PATH directory into the trie
+void pathDirectoryScan(struct pathDirectory *dir)
+{
+      struct stat st;
+      int i, kept = 0;
+      int fd = scanDirectory(dir->path, &dir->programs);
+
+      dir->scanned = 1;
+      if(fd < 0)
             return;
-      }
-      struct stat statbuf;
-      struct dirent *dirp;
-      DIR *dp;
-      dp = opendir(buf);
-      if(dp == NULL)
+      for(i = 0 ; i < dir->programs.count ; i++)
       {
-            printf("Error\n");
-            return;
+            struct dirItem *item = &dir->programs.items[i];
+            char *name = dir->programs.names.data + item->name;
+            if(item->type == DT_DIR || name[0] == '.')
+                  continue;
+            if(item->type != DT_REG && item->type != DT_LNK && (fstatat(fd, name, &st, 0) < 0 || !S_ISREG(st.st_mode)))
+                  continue; //links in PATH are taken to be programs, saving a stat each
+            dir->programs.items[kept++] = *item;
+            trieAdd(&pathTrie, name, 1);
       }
-      else
+      dir->programs.count = kept;
+      close(fd);
+}
+
+//Brings the trie up to date with PATH and with the directories' mtimes
+void pathTrieRefresh(void)
+{
+      char *pathVariable = sst_getenv("PATH") != NULL ? sst_getenv("PATH") : "";
+      struct stat st;
+      int i;
+
+      if(pathTriePath == NULL || strcmp(pathTriePath, pathVariable) != 0)
       {
-            while((dirp = readdir(dp)) != NULL)
+            char *copy, *dir;
+            for(i = 0 ; i < pathDirectoryCount ; i++)
             {
-                  char *path = malloc(sizeof(char)*100);
-                  strcpy(path,buf);
-                  strcat(path,"/");
-                  strcat(path,dirp->d_name);
-                  stat(path, &statbuf);
-                  displayInfo[i].name = malloc(sizeof(char)*strlen(dirp->d_name));
-                  strcpy(displayInfo[i].name,dirp->d_name);
-                  displayInfo[i].mtime = statbuf.st_ctime; //ctime in stat structure gives inode modification time
-                  i++;
+                  pathDirectoryDrop(&pathDirectories[i]);
+                  free(pathDirectories[i].path);
             }
-            //Sort according to mtime
-            int j,k;
-            for(j = 0 ; j < i-1 ; j++)
+            free(pathDirectories);
+            pathDirectories = NULL;
+            pathDirectoryCount = 0;
+            free(pathTriePath);
+            pathTriePath = strdup(pathVariable);
+            copy = strdup(pathVariable);
+            for(dir = strtok(copy, ":") ; dir != NULL ; dir = strtok(NULL, ":"))
             {
-                  for(k = 0 ; k < i - j - 1 ; k++)
+                  pathDirectories = realloc(pathDirectories, sizeof(struct pathDirectory) * (pathDirectoryCount + 1));
+                  if(!pathDirectories)
                   {
-                        if(displayInfo[k].mtime > displayInfo[k+1].mtime)
-                        {
-                              struct fileInfo temp = displayInfo[k];
-                              displayInfo[k] = displayInfo[k+1];
-                              displayInfo[k+1] = temp;
-                        }
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
                   }
+                  memset(&pathDirectories[pathDirectoryCount], 0, sizeof(struct pathDirectory));
+                  pathDirectories[pathDirectoryCount++].path = strdup(dir);
+            }
+            free(copy);
+      }
+      for(i = 0 ; i < pathDirectoryCount ; i++)
+      {
+            struct pathDirectory *dir = &pathDirectories[i];
+            int j;
+            if(stat(dir->path, &st) < 0)
+                  memset(&st, 0, sizeof(st));
+            if(dir->scanned && st.st_mtim.tv_sec == dir->mtime.tv_sec && st.st_mtim.tv_nsec == dir->mtime.tv_nsec
+                  && st.st_ino == dir->inode && st.st_dev == dir->device)
+                  continue;
+            if(dir->scanned)
+                  pathDirectoryDrop(dir);
+            dir->mtime = st.st_mtim;
+            dir->device = st.st_dev;
+            dir->inode = st.st_ino;
+            for(j = 0 ; j < i ; j++) //the same directory twice, e.g. /bin linked to /usr/bin
+            {
+                  if(st.st_ino != 0 && pathDirectories[j].inode == st.st_ino && pathDirectories[j].device == st.st_dev)
+                        break;
             }
+            if(j < i)
+                  dir->scanned = 1;
+            else
+                  pathDirectoryScan(dir);
+      }
+}
+
+struct completionList
+{
+      char **items;
+      int count;
+      int capacity;
+};
 
-            //print
-            for(j = 0 ; j < i ; j++)
+void completionAdd(struct completionList *list, const char *text, int length)
+{
+      if(list->count >= list->capacity)
+      {
+            list->capacity = list->capacity ? list->capacity * 2 : 64;
+            list->items = realloc(list->items, sizeof(char*) * list->capacity);
+            if(!list->items)
             {
-                  char *str = malloc(sizeof(char)*36);
-                  strftime(str, 36, "%d.%m.%Y %H:%M:%S", localtime(& displayInfo[j].mtime));
-                  printf("%s\t%s\n",displayInfo[j].name,str);
+                  fprintf(stderr, "sst: allocation error\n");
+                  exit(EXIT_FAILURE);
             }
       }
+      list->items[list->count++] = strndup(text, length);
 }
 
+//Adds every name below node; name holds the prefix leading to it
+void trieCollect(struct trieNode *node, char *name, int length, struct completionList *list)
+{
+      struct trieNode *child;
+
+      if(node->count > 0)
+            completionAdd(list, name, length);
+      if(length >= EDITOR_LINE_MAX - 1)
+            return;
+      for(child = node->child ; child != NULL ; child = child->sibling)
+      {
+            name[length] = child->c;
+            trieCollect(child, name, length + 1, list);
+      }
+}
 
-void pipeInputOutput(char *line)
+void completeCommand(char *word, int length, struct completionList *list)
 {
+      char name[EDITOR_LINE_MAX];
+      struct trieNode *node;
+      struct aliasEntry *e;
+      int i;
 
-      int i = 0;
-      int flagLessThan = 0;
-      int flagGreaterThan = 0;
-      while(line != NULL)
+      for(i = 0 ; i < sst_num_builtins() ; i++)
       {
-            if(line[i] == '<') //Input File
+            if(strncmp(builtin_str[i], word, length) == 0)
+                  completionAdd(list, builtin_str[i], strlen(builtin_str[i]));
+      }
+      for(i = 0 ; i < ALIAS_TABLE_SIZE ; i++)
+      {
+            for(e = aliasTable[i] ; e != NULL ; e = e->next)
             {
-                  flagLessThan = 1;
-                  break;
+                  if(strncmp(e->name, word, length) == 0)
+                        completionAdd(list, e->name, strlen(e->name));
             }
-            if(line[i] == '>') //Output File
+      }
+      pathTrieRefresh();
+      memcpy(name, word, length);
+      name[length] = '\0';
+      node = trieFind(&pathTrie, name);
+      if(node != NULL)
+            trieCollect(node, name, length, list);
+}
+
+//Completes a file name; directories get a trailing /
+void completeFile(char *word, int length, struct completionList *list)
+{
+      char directory[EDITOR_LINE_MAX], *base = word;
+      int baseLength = length, i, fd;
+      struct dirListing listing;
+      struct stat st;
+
+      for(i = length - 1 ; i >= 0 ; i--)
+      {
+            if(word[i] == '/')
             {
-                  flagGreaterThan = 1;
+                  base = word + i + 1;
+                  baseLength = length - i - 1;
                   break;
             }
-            i++;
       }
-      if(flagGreaterThan)
+      if(base == word)
+            strcpy(directory, ".");
+      else
       {
-            char **token = sst_split_line(line,"<");
-            token[1]=strtok(token[1]," "); //name of the input file file
-            char **tokenAgain = sst_split_line(token[0],">"); 
-            tokenAgain[1] = strtok(tokenAgain[1]," "); //name of the output file 
+            memcpy(directory, word, base - word);
+            directory[base - word] = '\0';
+      }
+      fd = scanDirectory(directory, &listing);
+      if(fd < 0)
+            return;
+      for(i = 0 ; i < listing.count ; i++)
+      {
+            char *name = DIR_ITEM_NAME(&listing, i);
+            char text[EDITOR_LINE_MAX];
+            int isDirectory = listing.items[i].type == DT_DIR;
+            if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || (name[0] == '.' && base[0] != '.'))
+                  continue;
+            if(strncmp(name, base, baseLength) != 0)
+                  continue;
+            if(listing.items[i].type == DT_LNK || listing.items[i].type == DT_UNKNOWN)
+                  isDirectory = fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+            int n = snprintf(text, sizeof(text), "%.*s%s%s", (int)(base - word), word, name, isDirectory ? "/" : "");
+            if(n < (int)sizeof(text))
+                  completionAdd(list, text, n);
+      }
+      close(fd);
+      dirListingFree(&listing);
+}
+
+int compareStrings(const void *a, const void *b)
+{
+      return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+//Handles Tab: completes the word before the cursor as far as it is unique,
+//and lists the choices on a second Tab
+void editorComplete(void)
+{
+      struct completionList list = {NULL, 0, 0};
+      int start = lineEditor.length, i, common, firstWord, length;
+      char *word;
 
-            redirectionLessThan = 0;
-            redirectionGreaterThan = 0;
+      while(start > 0 && lineEditor.line[start-1] != ' ' && lineEditor.line[start-1] != '\t')
+            start--;
+      word = lineEditor.line + start;
+      length = lineEditor.length - start;
+      for(firstWord = 1, i = 0 ; i < start ; i++)
+      {
+            if(lineEditor.line[i] != ' ' && lineEditor.line[i] != '\t')
+                  firstWord = 0;
+      }
+      if(firstWord && memchr(word, '/', length) == NULL)
+            completeCommand(word, length, &list);
+      else
+            completeFile(word, length, &list);
 
-            pid_t x;
-            int fd0,fd1;
-            x = fork();
-            if (x == 0) 
+      if(list.count > 1) //builtins, aliases and programs can share a name
+      {
+            qsort(list.items, list.count, sizeof(char*), compareStrings);
+            for(i = 1, common = 1 ; i < list.count ; i++)
+            {
+                  if(strcmp(list.items[i], list.items[common-1]) != 0)
+                        list.items[common++] = list.items[i];
+                  else
+                        free(list.items[i]);
+            }
+            list.count = common;
+      }
+      if(list.count == 0)
+      {
+            putchar('\a');
+      }
+      else
+      {
+            common = strlen(list.items[0]);
+            for(i = 1 ; i < list.count ; i++)
+            {
+                  int j = 0;
+                  while(j < common && list.items[i][j] == list.items[0][j])
+                        j++;
+                  common = j;
+            }
+            if(common > length)
+            {
+                  editorInsert(list.items[0] + length, common - length);
+                  if(list.count == 1 && list.items[0][common-1] != '/')
+                        editorInsert(" ", 1);
+            }
+            else if(list.count > 1 && lineEditor.lastWasTab)
             {
-                  fd0=open(token[1], O_RDONLY); 
-                  dup2(fd0,STDIN_FILENO);
-                  close(fd0);
-
-                  fd1 = creat(tokenAgain[1],0644); //create the output File
-
-                  dup2(fd1,STDOUT_FILENO);
-                  close(fd1);
-
-                  char **token1=sst_split_line(token[0],"|");
-                  parsePipedInput(token1); //execute the piping commands
-                  _exit(1);
-
-            } 
+                  putchar('\n');
+                  for(i = 0 ; i < list.count && i < COMPLETION_LIST_MAX ; i++)
+                        printf("%s  ", list.items[i]);
+                  if(list.count > COMPLETION_LIST_MAX)
+                        printf("... (%d more)", list.count - COMPLETION_LIST_MAX);
+                  putchar('\n');
+                  sst_prompt();
+                  editorShowLine();
+            }
             else
             {
-                  close(fd0);
-                  close(fd1);
-                  wait(NULL);
+                  putchar('\a');
             }
       }
-      else
-      {
-            char **token = sst_split_line(line,">"); 
-            token[1]=strtok(token[1]," "); //name of the output File
-            char **tokenAgain = sst_split_line(token[0],"<");
-            tokenAgain[1] = strtok(tokenAgain[1]," "); //name of the input File
+      for(i = 0 ; i < list.count ; i++)
+            free(list.items[i]);
+      free(list.items);
+}
 
-            redirectionLessThan = 0;
-            redirectionGreaterThan = 0;
+//Handles one key. Finished lines go to sstInput.
+void editorKey(unsigned char c)
+{
+      int tab = 0;
 
-            pid_t x;
-            int fd0,fd1;
-            x = fork();
-            if (x == 0) 
+      if(lineEditor.escape) //skip the rest of ESC [ ... letter
+      {
+            if(lineEditor.escape == 1 && (c == '[' || c == 'O'))
+                  lineEditor.escape = 2;
+            else if(lineEditor.escape == 1 || (c >= 0x40 && c <= 0x7e))
+                  lineEditor.escape = 0;
+            return;
+      }
+      if(c == '\r' || c == '\n')
+      {
+            putchar('\n');
+            sst_input_reserve(lineEditor.length + 1); //grows rather than losing the line
+            memcpy(sstInput.data + sstInput.end, lineEditor.line, lineEditor.length);
+            sstInput.end += lineEditor.length;
+            sstInput.data[sstInput.end++] = '\n';
+            lineEditor.length = 0;
+      }
+      else if(c == '\t')
+      {
+            editorComplete();
+            tab = 1;
+      }
+      else if(c == 127 || c == '\b')
+      {
+            if(lineEditor.length > 0)
             {
-                  fd0=open(tokenAgain[1], O_RDONLY);
-                  dup2(fd0,STDIN_FILENO);
-                  close(fd0);
-
-                  fd1 = creat(token[1],0644);
-
-                  dup2(fd1,STDOUT_FILENO);
-                  close(fd1);
-
-                  char **token1=sst_split_line(token[0],"|");
-                  parsePipedInput(token1);
-                  _exit(1);
-
-            } 
-            else 
+                  lineEditor.length--;
+                  fputs("\b \b", stdout);
+            }
+      }
+      else if(c == 21) //^U
+      {
+            while(lineEditor.length > 0)
             {
-                  close(fd0);
-                  close(fd1);
-                  wait(NULL);
+                  lineEditor.length--;
+                  fputs("\b \b", stdout);
             }
       }
+      else if(c == 3) //^C
+      {
+            fputs("^C\n", stdout);
+            lineEditor.length = 0;
+            sst_prompt();
+      }
+      else if(c == 27)
+      {
+            lineEditor.escape = 1;
+      }
+      else if(c >= ' ')
+      {
+            editorInsert((char *)&c, 1);
+      }
+      lineEditor.lastWasTab = tab;
 }
 
-void pipeAndOutput(char * line)
+//Reads what is available from the terminal. Returns 0 at end of input.
+int editorRead(void)
 {
-      char **token = sst_split_line(line,">"); 
-      token[1]=strtok(token[1]," "); //gets the output file
-      redirectionGreaterThan = 0;
-      int fd;
-      pid_t x;
-      x = fork();
-      if (x == 0)
+      unsigned char data[256];
+      ssize_t n, i;
+
+      do
       {
-            fd = creat(token[1],0644); //open the output file
-            close(STDOUT_FILENO);
-            fcntl(fd,F_DUPFD,STDOUT_FILENO);
-            char **args = sst_split_line(token[0],"|");
-            parsePipedInput(args);
-            _exit(1);
-      }
-      else
+            n = read(STDIN_FILENO, data, sizeof(data));
+      }while(n < 0 && errno == EINTR);
+      if(n <= 0)
+            return 0;
+      for(i = 0 ; i < n ; i++)
       {
-            wait(NULL);
+            if(data[i] == 4 && lineEditor.length == 0) //^D on an empty line
+                  return 0;
+            editorKey(data[i]);
       }
+      fflush(stdout);
+      return 1;
 }
 
-void pipeAndInput(char * line)
+void jobAdd(pid_t pid, char **args)
 {
-      char **token = sst_split_line(line,"<"); 
-      token[1]=strtok(token[1]," "); //gets input file name
-      redirectionLessThan = 0;
-      
-      int fd0;
-      pid_t x;
+      struct job *j = malloc(sizeof(struct job));
+      struct job **last = &jobList;
+
+      j->id = nextJobId++;
+      j->pid = pid;
+      j->command = sst_join_args(args);
+      clock_gettime(CLOCK_MONOTONIC, &j->start);
+      j->cgroup = currentLimit.cgroup; //the job owns the group from now on
+      currentLimit.cgroup = NULL;
+      j->next = NULL;
+      while(*last != NULL)
+            last = &(*last)->next;
+      *last = j;
+      printf("[%d] %d\n", j->id, (int)pid);
+}
+
+//Reports a job that has exited and removes it from the table
+void jobFinished(pid_t pid, int status)
+{
+      struct job **link = &jobList;
+      struct timespec now;
 
-      x = fork();
-      if (x == 0) 
+      while(*link != NULL && (*link)->pid != pid)
+            link = &(*link)->next;
+      if(*link == NULL)
+            return;
+      struct job *j = *link;
+      *link = j->next;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if(atPrompt)
+            printf("\n");
+      if(WIFEXITED(status))
+            printf("[%d] Done (%d) %.2f ms  %s\n", j->id, WEXITSTATUS(status), sst_elapsed_ms(&j->start, &now), j->command);
+      else
+            printf("[%d] Killed (signal %d) %.2f ms  %s\n", j->id, WTERMSIG(status), sst_elapsed_ms(&j->start, &now), j->command);
+      if(j->cgroup != NULL)
       {
-            fd0=open(token[1], O_RDONLY); //Open file with fd - 0
-            dup2(fd0,STDIN_FILENO);
-            close(fd0);
+            struct cgroupUsage usage;
+            cgroupReadUsage(j->cgroup, &usage);
+            printf("    ");
+            cgroupPrint(&usage, stdout);
+            cgroupRemove(j->cgroup);
+            free(j->cgroup);
+      }
+      free(j->command);
+      free(j);
+      if(jobList == NULL)
+            nextJobId = 1;
+      if(atPrompt)
+      {
+            sst_prompt();
+            editorShowLine(); //what was typed before the notice
+      }
+}
 
-            char **token1=sst_split_line(token[0],"|");
-            parsePipedInput(token1);
-            _exit(1);
-      } 
-      else 
+void jobReapAll(void)
+{
+      struct job *j = jobList;
+      int status;
+
+      while(j != NULL)
       {
-            wait(NULL);
+            struct job *next = j->next;
+            if(waitpid(j->pid, &status, WNOHANG) == j->pid)
+                  jobFinished(j->pid, status);
+            j = next;
       }
 }
 
-void onlyRedirection(char *line)
+int sst_jobs(char **args)
 {
-      int i = 0;
-      int flagLessThan = 0;
-      int flagGreaterThan = 0;
-      while(line != NULL)
+      struct job *j;
+      struct timespec now;
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      for(j = jobList ; j != NULL ; j = j->next)
       {
-            if(line[i] == '<')
-            {
-                  flagLessThan = 1;
-                  break;
-            }
-            if(line[i] == '>')
+            printf("[%d] %-7d running %.0f ms  %s\n", j->id, (int)j->pid, sst_elapsed_ms(&j->start, &now), j->command);
+            if(j->cgroup != NULL)
             {
-                  flagGreaterThan = 1;
-                  break;
+                  struct cgroupUsage usage;
+                  char text[32];
+                  cgroupReadUsage(j->cgroup, &usage);
+                  printf("    ");
+                  if(cgroupRead(j->cgroup, "memory.current", text, sizeof(text)) > 0)
+                        printf("memory.current %lld KB ", atoll(text) / 1024);
+                  cgroupPrint(&usage, stdout);
             }
-            i++;
       }
+      return 1;
+}
 
-      if(flagGreaterThan)
+void addHistory(char *line)
+{
+      time_t myTime;
+      time(&myTime); //gets the current time
+      char *t = (char*)malloc(sizeof(char)*200);
+      strcpy(t,ctime(&myTime)); //store the time in t . ctime makes the time readable 
+      if(head == NULL)
       {
-            char **token = sst_split_line(line,"<");
-            token[1]=strtok(token[1]," "); //gets input flag
-            char **tokenAgain = sst_split_line(token[0],">");
-            tokenAgain[1] = strtok(tokenAgain[1]," "); //gives output file
-            redirectionLessThan = 0;
-            redirectionGreaterThan = 0;
-
-            pid_t x;
-            int fd0,fd1;
-            x = fork();
-            if (x == 0) 
-            {
-                  fd0=open(token[1], O_RDONLY); 
-                  dup2(fd0,STDIN_FILENO);
-                  close(fd0);
-
-                  fd1 = creat(tokenAgain[1],0644); //create the output file
-
-                  dup2(fd1,STDOUT_FILENO);
-                  close(fd1);
-                
-                  char **token1=sst_split_line(token[0]," ");
-                  execvp(token1[0], token1);
-                  perror("execvp");
-                  _exit(1);
-            } 
+            head = newNode(line);
+            head->timestamp = t;
+            tail = head;
+            totalNodes++;
+      }
+      else
+      {
+            struct node *temp = newNode(line);
+            temp->next = NULL;
+            temp->prev = tail;
+            tail->next = temp;
+            temp->timestamp = t;
+            tail = temp;
+            if(totalNodes <= 25)
+            {
+                  totalNodes++;
+            }
             else
             {
-                  wait(NULL);
+                  struct node *temp = head; //moving head to the second node and freeing the first node. 
+                                          //Later the new node will be added after tail
+                  head = head->next;
+                  head -> prev = NULL;
+                  free(temp);
             }
       }
-      else
+}
+
+//Arms the periodic timer only while something needs it, so an idle shell sleeps
+void sst_update_timer(int timerFd)
+{
+      struct itimerspec spec;
+
+      memset(&spec, 0, sizeof(spec));
+      if(traceSink.path != NULL)
       {
-            char **token = sst_split_line(line,">");
-            token[1]=strtok(token[1]," "); //gets output file 
-            char **tokenAgain = sst_split_line(token[0],"<");
-            tokenAgain[1] = strtok(tokenAgain[1]," "); //gets input file
+            spec.it_interval.tv_nsec = TRACE_FLUSH_INTERVAL_MS * 1000000L;
+            spec.it_value = spec.it_interval;
+      }
+      timerfd_settime(timerFd, 0, &spec, NULL);
+}
+
+/*
+  The REPL is one epoll loop over terminal input, a signalfd for SIGCHLD and
+  a timerfd. Commands still run to completion one at a time, but background
+  job notices and trace flushing no longer wait for the user to press Enter.
+*/
+void sst_loop(void)
+{
+        varSet("SHELL","/bin/ownsh",1);
+        int status = 1;
+        printf("************************\n\n");
+        printf("Welcome to SST shell!\n");
+        printf("************************\n\n");
 
-            redirectionLessThan = 0;
-            redirectionGreaterThan = 0;
+        sigset_t mask;
+        struct epoll_event event, events[8];
+        int epollFd, signalFd, timerFd, inputPollable;
+        int i, n;
 
-            pid_t x;
-            int fd0,fd1;
-            x = fork();
-            if (x == 0) 
-            {
-                  fd0=open(tokenAgain[1], O_RDONLY);
-                  dup2(fd0,STDIN_FILENO);
-                  close(fd0);
+        lineEditor.enabled = isatty(STDIN_FILENO);
+        sst_input_reserve(SST_INPUT_BUFSIZE); //the line editor appends to it without reading
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &shellSignalMask);
+        signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(signalFd < 0 || timerFd < 0 || epollFd < 0)
+        {
+              perror("sst");
+              exit(EXIT_FAILURE);
+        }
+        event.events = EPOLLIN;
+        event.data.fd = signalFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+        event.data.fd = timerFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+        event.data.fd = STDIN_FILENO;
+        //regular files cannot be polled, but reading them never blocks either
+        inputPollable = epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0;
 
-                  fd1 = creat(token[1],0644);
+        sst_prompt();
+        while(status)
+        {
+              n = epoll_wait(epollFd, events, 8, inputPollable ? -1 : 0);
+              if(n < 0 && errno != EINTR)
+              {
+                    perror("sst");
+                    break;
+              }
+              if(!inputPollable && n <= 0)
+              {
+                    events[0].data.fd = STDIN_FILENO;
+                    n = 1;
+              }
+              for(i = 0 ; i < n && status ; i++)
+              {
+                    if(events[i].data.fd == signalFd)
+                    {
+                          struct signalfd_siginfo info;
+                          while(read(signalFd, &info, sizeof(info)) == sizeof(info))
+                                ;
+                          jobReapAll();
+                    }
+                    else if(events[i].data.fd == timerFd)
+                    {
+                          uint64_t expirations;
+                          while(read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                                ;
+                          traceFlush();
+                    }
+                    else
+                    {
+                          if(lineEditor.enabled ? editorRead() == 0 : (sst_fill_input() == 0 && sstInput.start == sstInput.end))
+                          {
+                                status = 0; //end of input
+                                break;
+                          }
+                          while(status && sst_input_has_line())
+                          {
+                                char *line = sst_read_line();
+                                editorCookedMode(); //commands may read the terminal themselves
+                                atPrompt = 0;
+                                flag = 0;
+                                addHistory(line);
+                                status = checkForCommands(line);
+                                free(line);
+                                if(isatty(STDIN_FILENO))
+                                      sstInput.eof = 0; //a ^D that ended cat2 or the editor only ended that command
+                                traceFlushDue(); //a long run of lines never waits for the timer
+                                if(status)
+                                      sst_prompt();
+                          }
+                          if(sstInput.eof && sstInput.start == sstInput.end)
+                                status = 0;
+                    }
+              }
+              sst_update_timer(timerFd);
+        }
+        editorCookedMode();
+        close(epollFd);
+        close(timerFd);
+        close(signalFd);
+        sigprocmask(SIG_SETMASK, &shellSignalMask, NULL);
+}
 
-                  dup2(fd1,STDOUT_FILENO);
-                  close(fd1);
 
-                  char **token1=sst_split_line(token[0]," ");
-                  execvp(token1[0], token1);
-                  perror("execvp");
-                  _exit(1);
-            } 
-            else 
-            {
-                  wait(NULL);
-            }
+/*
+  Command server. "ownsh --serve /path/sock" listens on a Unix socket and
+  runs command lines sent by local clients, so automation does not start a
+  new shell for every command. Each connection is served by its own process
+  and each request runs in a fresh child, so env and cwd overrides do not
+  leak into the next request. Requests on one connection run one after
+  another, each answered with its X frame before the next is read, so a
+  client that wants commands to run in parallel opens several connections.
+  Frames are a type byte, a 4 byte big-endian length and the payload.
+
+    client -> shell   C command line, V NAME=value (repeatable), D cwd, R run
+    shell -> client   O stdout bytes, E stderr bytes,
+                      X "status wall_ms user_ms sys_ms" once the command is done
+*/
+#define SERVE_MAX_FRAME (1 << 20)
+
+//Reads or writes exactly length bytes. Returns -1 on error or early EOF.
+int serveTransfer(int fd, char *data, size_t length, int writing)
+{
+      while(length > 0)
+      {
+            ssize_t n = writing ? write(fd, data, length) : read(fd, data, length);
+            if(n < 0 && errno == EINTR)
+                  continue;
+            if(n <= 0)
+                  return -1;
+            data += n;
+            length -= n;
       }
+      return 0;
 }
 
-void readFromInputFile(char *line)
+int serveWriteFrame(int fd, char type, const char *data, uint32_t length)
 {
-      char **token = sst_split_line(line,"<");
-      token[1]=strtok(token[1]," "); //gives input file name
-      redirectionLessThan = 0;
-      int fd0;
-      pid_t x;
-      x = fork();
-      if (x == 0) 
-      {
-            fd0=open(token[1], O_RDONLY); //opens the input file
-            dup2(fd0,STDIN_FILENO);
-            close(fd0);
+      unsigned char header[5];
 
-            char **args = sst_split_line(token[0]," ");
-            execvp(args[0], args);
-            perror("execvp");
-            _exit(1);
-      }
-      else 
-      {
-            wait(NULL);
-      }
+      header[0] = type;
+      header[1] = length >> 24;
+      header[2] = length >> 16;
+      header[3] = length >> 8;
+      header[4] = length;
+      if(serveTransfer(fd, (char *)header, 5, 1) < 0)
+            return -1;
+      return serveTransfer(fd, (char *)data, length, 1);
 }
 
-void readFromOutputFile(char *line)
+//Reads one frame into a NUL terminated malloc'd payload. Returns -1 at EOF or on a bad frame.
+int serveReadFrame(int fd, char *type, char **data)
 {
-      char **token = sst_split_line(line,">");
-      token[1]=strtok(token[1]," "); //gets output file name
-      redirectionGreaterThan = 0;
-      int fd0;
-      pid_t x;
-      x = fork();
-      if (x == 0)
+      unsigned char header[5];
+      uint32_t length;
+
+      if(serveTransfer(fd, (char *)header, 5, 0) < 0)
+            return -1;
+      length = (uint32_t)header[1] << 24 | header[2] << 16 | header[3] << 8 | header[4];
+      if(length > SERVE_MAX_FRAME)
+            return -1;
+      *type = header[0];
+      *data = malloc(length + 1);
+      if(!*data)
       {
-            fd0 = creat(token[1],0644);
-            dup2(fd0,STDOUT_FILENO);
-            close(fd0);
-            char **args = sst_split_line(token[0]," ");
-            execvp(args[0], args);
-            perror("execvp");
-            _exit(1);
+            fprintf(stderr, "sst: allocation error\n");
+            exit(EXIT_FAILURE);
       }
-      else
+      (*data)[length] = '\0';
+      if(serveTransfer(fd, *data, length, 0) < 0)
       {
-            wait(NULL);
+            free(*data);
+            return -1;
       }
+      return 0;
 }
 
-
-void parsePipedInput(char **token)
+//Runs one request and streams its output back to the client
+int serveRun(int client, char *command, char *cwd, char **env, int envCount)
 {
-      int i=0;
-      pipeInInputFlag = 0;
-      int pipefd[2]; 
-      pid_t p1, p2;
-      while(token[i+1]!=NULL)
+      int out[2], err[2];
+      struct pollfd fds[2];
+      struct timespec start, end;
+      struct rusage usage;
+      char data[SST_STREAM_BUFSIZE];
+      int status = 0, openPipes, i, result = 0;
+      pid_t pid;
+
+      if(pipe(out) < 0 || pipe(err) < 0)
+      {
+            perror("sst");
+            return -1;
+      }
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      pid = sst_fork();
+      if(pid == 0)
       {
-            if (pipe(pipefd) < 0) 
+            int nullFd = open("/dev/null", O_RDONLY);
+            dup2(nullFd, STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            dup2(err[1], STDERR_FILENO);
+            close(nullFd);
+            close(out[0]);
+            close(out[1]);
+            close(err[0]);
+            close(err[1]);
+            close(client);
+            for(i = 0 ; i < envCount ; i++)
             {
-                  printf("\nPipe could not be initialized");
-                  return;
+                  char *equals = strchr(env[i], '=');
+                  *equals = '\0';
+                  varSet(env[i], equals + 1, 1);
             }
-            p1 = fork();
-            if (p1 < 0) 
+            if(cwd != NULL && chdir(cwd) < 0)
             {
-                  printf("\nCould not fork");
-                  return;
+                  perror("sst");
+                  _exit(1);
             }
-            if (p1 == 0) 
+            checkForCommands(command);
+            traceStop(); //a request that turned tracing on owns the file
+            fflush(stdout);
+            fflush(stderr);
+            _exit(lastExitStatus);
+      }
+      close(out[1]);
+      close(err[1]);
+      if(pid < 0)
+      {
+            perror("sst");
+            close(out[0]);
+            close(err[0]);
+            return -1;
+      }
+
+      fds[0].fd = out[0];
+      fds[1].fd = err[0];
+      fds[0].events = fds[1].events = POLLIN;
+      openPipes = 2;
+      while(openPipes > 0)
+      {
+            if(poll(fds, 2, -1) < 0)
             {
-                  close(pipefd[0]); //closing the write end
-                  dup2(pipefd[1], STDOUT_FILENO); //opening the read end
-                  close(pipefd[1]);
-                  char **args = sst_split_line(token[i], " ");
-                  if (execvp(args[0], args) < 0) 
-                  {
-                        printf("\nCould not execute command..\n");
-                  }
-            } 
-            else 
+                  if(errno == EINTR)
+                        continue;
+                  break;
+            }
+            for(i = 0 ; i < 2 ; i++)
             {
-                  p2 = fork();
-                  if (p2 < 0) 
+                  if(fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                        continue;
+                  ssize_t n = read(fds[i].fd, data, sizeof(data));
+                  if(n < 0 && errno == EINTR)
+                        continue;
+                  if(n <= 0)
                   {
-                        printf("\nCould not fork");
-                        return;
+                        close(fds[i].fd);
+                        fds[i].fd = -1;
+                        openPipes--;
                   }
-                  if (p2 == 0) 
+                  else if(result == 0 && serveWriteFrame(client, i == 0 ? 'O' : 'E', data, n) < 0)
                   {
-                        close(pipefd[1]); //closing the read end
-                        dup2(pipefd[0], STDIN_FILENO);
-                        close(pipefd[0]); //opening the write end
-                        char **args = sst_split_line(token[i+1], " ");
-                        if (execvp(args[0], args) < 0) 
-                        {
-                              printf("\nCould not execute command..");
-                        }
-                  } 
-                  else 
-                  {
-                        close(pipefd[1]);
-                        close(pipefd[0]);
-                        wait(NULL);
-                        wait(NULL);
+                        result = -1; //client went away, keep draining so the command can finish
                   }
             }
-            i++;
       }
+      while(wait4(pid, &status, 0, &usage) < 0 && errno == EINTR)
+            ;
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      if(result < 0)
+            return -1;
+      int length = snprintf(data, sizeof(data), "%d %.3f %.3f %.3f",
+            WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status),
+            sst_elapsed_ms(&start, &end), sst_timeval_ms(&usage.ru_utime), sst_timeval_ms(&usage.ru_stime));
+      return serveWriteFrame(client, 'X', data, length);
 }
 
-void printFilesWithRegex(char *regex)
+//Serves requests from one client, one at a time, until it disconnects
+void serveConnection(int client)
 {
-  
-      wordexp_t p;
-      char **w;
-      int i;
-      wordexp(regex, &p, 0);
-      w = p.we_wordv;
-      for (i = 0; i < p.we_wordc; i++)
+      char *command = NULL, *cwd = NULL, *payload;
+      char **env = NULL;
+      int envCount = 0, i;
+      char type;
+
+      while(serveReadFrame(client, &type, &payload) == 0)
       {
-            printf("%s\n", w[i]);
+            if(type == 'C')
+            {
+                  free(command);
+                  command = payload;
+            }
+            else if(type == 'D')
+            {
+                  free(cwd);
+                  cwd = payload;
+            }
+            else if(type == 'V' && strchr(payload, '=') != NULL)
+            {
+                  env = realloc(env, sizeof(char*) * (envCount + 1));
+                  if(!env)
+                  {
+                        fprintf(stderr, "sst: allocation error\n");
+                        exit(EXIT_FAILURE);
+                  }
+                  env[envCount++] = payload;
+            }
+            else if(type == 'R')
+            {
+                  free(payload);
+                  if(serveRun(client, command != NULL ? command : "", cwd, env, envCount) < 0)
+                        break;
+                  free(command);
+                  free(cwd);
+                  for(i = 0 ; i < envCount ; i++)
+                        free(env[i]);
+                  command = cwd = NULL;
+                  envCount = 0;
+            }
+            else
+            {
+                  free(payload);
+            }
       }
-      wordfree(&p);
+      close(client);
 }
 
-void sst_loop(void)
+int sst_serve(char *path)
 {
-        setenv("SHELL","/bin/ownsh",1);
-        int status;
-       printf("************************\n\n");
-        printf("Welcome to SST shell!\n");
-        printf("************************\n\n");
-         time_t myTime;
+      struct sockaddr_un address;
+      struct stat st;
+      int listenFd, client;
 
-        do 
-        {
-            char *line;
-            char **args;
-            char *buf = malloc(sizeof(char) * 100);
-            size_t size = 100;
-            getcwd(buf,size);
-            printf("%s~$ ",buf);
-            line = sst_read_line();
-            time(&myTime); //gets the current time
-            char *t = (char*)malloc(sizeof(char)*200);
-            strcpy(t,ctime(&myTime)); //store the time in t . ctime makes the time readable 
-            flag = 0;
-            if(head == NULL)
-            {
-                  head = newNode(line);
-                  head->timestamp = (char*)malloc(sizeof(char) * 200);
-                  strcpy(head->timestamp,t);
-                  tail = head;
-                  totalNodes++;
+      if(strlen(path) >= sizeof(address.sun_path))
+      {
+            fprintf(stderr, "sst: socket path too long\n");
+            return EXIT_FAILURE;
+      }
+      if(lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode)) //only a stale socket may be replaced
+      {
+            fprintf(stderr, "sst: %s exists and is not a socket\n", path);
+            return EXIT_FAILURE;
+      }
+      memset(&address, 0, sizeof(address));
+      address.sun_family = AF_UNIX;
+      strcpy(address.sun_path, path);
+      listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      unlink(path);
+      if(listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, 128) < 0)
+      {
+            perror("sst");
+            return EXIT_FAILURE;
+      }
+      varSet("SHELL","/bin/ownsh",1);
+      signal(SIGPIPE, SIG_IGN);
+      signal(SIGCHLD, SIG_IGN); //connection processes reap themselves
+      while(1)
+      {
+            client = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+            if(client < 0)
+            {
+                  if(errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                  perror("sst");
+                  return EXIT_FAILURE;
             }
-            else
+            pid_t pid = fork();
+            if(pid == 0)
             {
-                  struct node *temp = newNode(line);
-                  temp->next = NULL;
-                  temp->prev = tail;
-                  tail->next = temp;
-                  temp->timestamp = (char*)malloc(sizeof(char) * 200);
-                  strcpy(temp->timestamp,t);
-                  tail = temp;
-                  if(totalNodes <= 25)
-                  {
-                        totalNodes++;
-                  }
-                  else
-                  {
-                        struct node *temp = head; //moving head to the second node and freeing the first node. 
-                                                //Later the new node will be added after tail
-                        head = head->next;
-                        head -> prev = NULL;
-                        free(temp);
-                  }
+                  signal(SIGCHLD, SIG_DFL); //so the commands can be waited for
+                  close(listenFd);
+                  serveConnection(client);
+                  _exit(0);
             }
+            if(pid < 0)
+                  perror("sst");
+            close(client);
+      }
+}
 
-            status= checkForCommands(line);
+//Runs "ownsh script args...": one command per line, with $0, $1, ... and $# set
+int runScript(int argc, char **argv)
+{
+      FILE *fp = fopen(argv[0], "r");
+      char *line = NULL;
+      size_t size = 0;
+      ssize_t length;
 
-            free(line);
-            free(args);
-            }while (status);
+      if(fp == NULL)
+      {
+            fprintf(stderr, "sst: %s: %s\n", argv[0], strerror(errno));
+            return 127;
+      }
+      scriptInput = fp; //here-document bodies come from the script too
+      scriptName = argv[0];
+      scriptArgs = argv + 1;
+      scriptArgCount = argc - 1;
+      varSet("SHELL","/bin/ownsh",1);
+      while((length = getline(&line, &size, fp)) >= 0)
+      {
+            char *start = line;
+            while(length > 0 && (line[length-1] == '\n' || line[length-1] == '\r'))
+                  line[--length] = '\0';
+            while(*start == ' ' || *start == '\t')
+                  start++;
+            if(*start == '\0' || *start == '#') //also skips a #! line
+                  continue;
+            if(checkForCommands(start) == 0)
+                  break; //exit
+            traceFlushDue();
+      }
+      free(line);
+      fclose(fp);
+      scriptInput = NULL;
+      traceStop();
+      return lastExitStatus;
 }
 
-
 int main(int argc, char **argv)
 {
-      aliasArray = (struct alias*)malloc(sizeof(struct alias) * 10) ; //Maximum 10 aliases
+      varInit();
+      execCountersInit();
+      if(sst_getenv("SST_ZYGOTE") != NULL && strcmp(sst_getenv("SST_ZYGOTE"), "1") == 0)
+      {
+            zygoteStart(); //before anything else is allocated
+      }
+      if(sst_getenv("SST_TIMEOUT") != NULL && !isatty(STDIN_FILENO))
+      {
+            defaultTimeout = parseDuration(sst_getenv("SST_TIMEOUT"));
+            if(defaultTimeout < 0)
+            {
+                  fprintf(stderr, "sst: ignoring bad SST_TIMEOUT \"%s\"\n", sst_getenv("SST_TIMEOUT"));
+                  defaultTimeout = 0;
+            }
+      }
 
+      loadRcFile();
+      if(argc == 3 && strcmp(argv[1], "--serve") == 0)
+      {
+            return sst_serve(argv[2]);
+      }
+      if(argc >= 2)
+      {
+            return runScript(argc - 1, argv + 1);
+      }
       sst_loop();
+      traceStop();
+      if(commandTableDirty)
+            snapshotSave(); //keep the programs looked up this session
       return EXIT_SUCCESS;
 }
@@ -0,0 +1,43 @@
+/*
+  LD_PRELOAD shim for the zygote benchmark. It grows the shell by
+  BALLAST_MB of touched memory right after the shell's first fork, which
+  is the zygote when SST_ZYGOTE=1, so the zygote stays small while every
+  fork from the shell has to copy the page tables of a large process.
+  LD_PRELOAD is taken out of the environment so the commands the shell
+  runs do not load the shim.
+
+    gcc -O2 -shared -fPIC -o ballast.so ballast.c -ldl
+    BALLAST_MB=1024 LD_PRELOAD=./ballast.so ownsh
+*/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+static pid_t shellPid;
+static char *ballast; //kept so the compiler cannot drop the memory
+
+__attribute__((constructor)) static void ballastInit(void)
+{
+      shellPid = getpid();
+      unsetenv("LD_PRELOAD");
+}
+
+pid_t fork(void)
+{
+      static pid_t (*realFork)(void);
+      pid_t pid;
+
+      if(realFork == NULL)
+            realFork = (pid_t (*)(void))dlsym(RTLD_NEXT, "fork");
+      pid = realFork();
+      if(pid > 0 && ballast == NULL && getpid() == shellPid && getenv("BALLAST_MB") != NULL)
+      {
+            size_t size = strtoul(getenv("BALLAST_MB"), NULL, 10) << 20;
+            ballast = malloc(size);
+            if(ballast != NULL)
+                  memset(ballast, 1, size);
+      }
+      return pid;
+}
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Glob expansion in a directory of F files: "ls <pattern>" lines, which the
+# shell expands with wordexp, for a pattern matching every file, one
+# matching a tenth of them and one matching a single file.
+#
+#   ./benchmarks/glob.sh [files] [N]      (defaults 10000 and 200)
+
+FILES=${1:-10000}
+N=${2:-200}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+MKFILES_BIN=${MKFILES_BIN:-/tmp/ownsh-mkfiles}
+WORK=$(mktemp -d /tmp/ownsh-glob.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+gcc -O2 -o "$MKFILES_BIN" "$ROOT/benchmarks/mkfiles.c" || exit 1
+"$MKFILES_BIN" "$WORK/dir" "$FILES" || exit 1
+
+run()
+{
+      local name=$1 pattern=$2
+      local start end
+      { echo "cd $WORK/dir"; yes "ls $pattern" | head -n "$N"; } > "$WORK/script"
+      start=$(date +%s%N)
+      "$SHELL_BIN" "$WORK/script" > /dev/null 2>&1
+      end=$(date +%s%N)
+      awk -v name="$name" -v files="$FILES" -v n="$N" -v ns=$((end - start)) \
+            'BEGIN { printf "{\"benchmark\":\"%s\",\"files\":%d,\"count\":%d,\"per_op_us\":%.2f}\n", name, files, n, ns / 1e3 / n }'
+}
+
+run glob_all 'file*'
+run glob_tenth 'file*0'
+run glob_one 'file0000001*'
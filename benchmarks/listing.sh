@@ -0,0 +1,33 @@
+#!/bin/bash
+# ls -z and ls -itime on synthetic directories. Each size is listed enough
+# times to take a measurable while; the directory is created once with
+# mkfiles and listed from a warm cache.
+#
+#   ./benchmarks/listing.sh [sizes...]      (defaults 1000 100000 1000000)
+
+SIZES=${*:-1000 100000 1000000}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+MKFILES_BIN=${MKFILES_BIN:-/tmp/ownsh-mkfiles}
+WORK=$(mktemp -d /tmp/ownsh-listing.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+gcc -O2 -o "$MKFILES_BIN" "$ROOT/benchmarks/mkfiles.c" || exit 1
+
+for size in $SIZES; do
+      "$MKFILES_BIN" "$WORK/dir$size" "$size" || exit 1
+      repeat=$((1000000 / size))
+      [ "$repeat" -gt 100 ] && repeat=100
+      [ "$repeat" -lt 1 ] && repeat=1
+      for command in "ls -z" "ls -itime"; do
+            { echo "cd $WORK/dir$size"; yes "$command" | head -n "$repeat"; } > "$WORK/script"
+            "$SHELL_BIN" "$WORK/script" > /dev/null 2>&1 #warms the dentry cache
+            start=$(date +%s%N)
+            "$SHELL_BIN" "$WORK/script" > /dev/null 2>&1
+            end=$(date +%s%N)
+            awk -v name="$command" -v size="$size" -v n="$repeat" -v ns=$((end - start)) \
+                  'BEGIN { sub(/ -/, "_", name); printf "{\"benchmark\":\"%s\",\"files\":%d,\"runs\":%d,\"per_run_ms\":%.2f,\"per_file_ns\":%.1f}\n", name, size, n, ns / 1e6 / n, ns / n / size }'
+      done
+      rm -rf "$WORK/dir$size"
+done
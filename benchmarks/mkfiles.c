@@ -0,0 +1,47 @@
+/*
+  Fills a directory with synthetic files for the listing benchmarks. Every
+  fourth file gets one byte so ls -z has both kinds to tell apart.
+
+    mkfiles <dir> <count>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+int main(int argc, char **argv)
+{
+      char path[4096];
+      long count, i;
+      int fd;
+
+      if(argc != 3)
+      {
+            fprintf(stderr, "usage: mkfiles <dir> <count>\n");
+            return 2;
+      }
+      count = atol(argv[2]);
+      if(mkdir(argv[1], 0755) < 0)
+      {
+            perror(argv[1]);
+            return 1;
+      }
+      for(i = 0 ; i < count ; i++)
+      {
+            snprintf(path, sizeof(path), "%s/file%07ld", argv[1], i);
+            fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if(fd < 0)
+            {
+                  perror(path);
+                  return 1;
+            }
+            if(i % 4 == 0 && write(fd, "x", 1) != 1)
+            {
+                  perror(path);
+                  return 1;
+            }
+            close(fd);
+      }
+      return 0;
+}
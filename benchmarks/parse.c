@@ -0,0 +1,97 @@
+/*
+  Parser microbenchmark. Builds the shell into this program with its main
+  renamed, generates a corpus of command lines and times the tokenizer, the
+  expansion pass and the whole of checkForCommands on lines that stay
+  inside the shell (builtins and assignments, with stdout on /dev/null).
+  Prints one JSON line per measurement.
+
+    parse [lines]      (defaults to 1000000)
+*/
+#define main ownsh_main
+#include "../Own Shell.c"
+#undef main
+
+static const char *templates[] = {
+      "ls -l /tmp/dir%d",
+      "cat file%d.txt | grep -v pattern | wc -l",
+      "gcc -O2 -Wall -o prog%d main.c util.c",
+      "echo value %d > out.txt",
+      "sort < input%d.txt",
+      "git log --oneline -n %d",
+      "echo $HOME/${USER}/%d $?",
+      "X%d=value",
+};
+#define TEMPLATE_COUNT (sizeof(templates) / sizeof(templates[0]))
+
+static void report(const char *name, long lines, struct timespec *start, struct timespec *end)
+{
+      double ms = sst_elapsed_ms(start, end);
+      printf("{\"benchmark\":\"%s\",\"lines\":%ld,\"total_ms\":%.1f,\"per_line_ns\":%.1f,\"lines_per_sec\":%.0f}\n",
+            name, lines, ms, ms * 1e6 / lines, lines / (ms / 1000.0));
+      fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+      long count = argc > 1 ? atol(argv[1]) : 1000000;
+      char **corpus = malloc(sizeof(char *) * count);
+      char line[256];
+      struct timespec start, end;
+      long i;
+      int devnull;
+
+      if(corpus == NULL || count <= 0)
+            return 1;
+      varInit();
+      for(i = 0 ; i < count ; i++)
+      {
+            snprintf(line, sizeof(line), templates[i % TEMPLATE_COUNT], (int)i);
+            corpus[i] = strdup(line);
+      }
+
+      //sst_split_line works in place, so every line is copied first
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(i = 0 ; i < count ; i++)
+      {
+            char **args;
+            strcpy(line, corpus[i]);
+            args = sst_split_line(line, " \t\r\n\a");
+            free(args);
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      report("parse_split_line", count, &start, &end);
+      pipeInInputFlag = redirectionLessThan = redirectionGreaterThan = 0; //set by the tokenizer for the executor
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(i = 0 ; i < count ; i++)
+            free(expandLine(corpus[i]));
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      report("parse_expand_line", count, &start, &end);
+
+      //builtin lines only: nothing is forked, so this is the shell's own cost
+      for(i = 0 ; i < count ; i++)
+      {
+            free(corpus[i]);
+            if(i % 2 == 0)
+                  snprintf(line, sizeof(line), "echo -n word%ld $HOME", i);
+            else
+                  snprintf(line, sizeof(line), "X%ld=value", i % 1000);
+            corpus[i] = strdup(line);
+      }
+      fflush(stdout);
+      devnull = dup(STDOUT_FILENO);
+      if(freopen("/dev/null", "w", stdout) == NULL)
+            return 1;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(i = 0 ; i < count ; i++)
+            checkForCommands(corpus[i]);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      fflush(stdout);
+      dup2(devnull, STDOUT_FILENO);
+      report("parse_check_for_commands", count, &start, &end);
+
+      for(i = 0 ; i < count ; i++)
+            free(corpus[i]);
+      free(corpus);
+      return 0;
+}
@@ -0,0 +1,12 @@
+#!/bin/bash
+# Builds parse.c against the shell's source and runs it on a corpus of
+# N generated command lines.
+#
+#   ./benchmarks/parse.sh [N]      (N defaults to 1000000)
+
+N=${1:-1000000}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PARSE_BIN=${PARSE_BIN:-/tmp/ownsh-parse}
+
+gcc -O2 -o "$PARSE_BIN" "$ROOT/benchmarks/parse.c" || exit 1
+"$PARSE_BIN" "$N"
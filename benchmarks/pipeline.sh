@@ -0,0 +1,30 @@
+#!/bin/bash
+# Throughput of N-stage pipelines through parsePipedInput: a file of the
+# given size is pushed through "cat file | cat | ... | wc -c" with 1, 2, 4
+# and 8 cat stages in front of wc.
+#
+#   ./benchmarks/pipeline.sh [MB] [runs]      (defaults 256 and 3)
+
+MB=${1:-256}
+RUNS=${2:-3}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+WORK=$(mktemp -d /tmp/ownsh-pipeline.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+head -c "$((MB << 20))" /dev/urandom > "$WORK/input"
+
+for stages in 1 2 4 8; do
+      line="cat $WORK/input"
+      for i in $(seq 2 "$stages"); do
+            line="$line | cat"
+      done
+      line="$line | wc -c"
+      yes "$line" | head -n "$RUNS" > "$WORK/script"
+      start=$(date +%s%N)
+      "$SHELL_BIN" "$WORK/script" > /dev/null 2>&1
+      end=$(date +%s%N)
+      awk -v stages="$stages" -v mb="$MB" -v runs="$RUNS" -v ns=$((end - start)) \
+            'BEGIN { printf "{\"benchmark\":\"pipeline\",\"stages\":%d,\"mb\":%d,\"runs\":%d,\"per_run_ms\":%.1f,\"mb_per_s\":%.1f}\n", stages, mb, runs, ns / 1e6 / runs, mb * runs / (ns / 1e9) }'
+done
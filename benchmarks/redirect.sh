@@ -0,0 +1,34 @@
+#!/bin/bash
+# Cost of redirection: the same external command N times plain, with its
+# output redirected to a file and with its input redirected from one. The
+# difference from the plain run is what the redirection adds.
+#
+#   ./benchmarks/redirect.sh [N]      (N defaults to 5000)
+
+N=${1:-5000}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+WORK=$(mktemp -d /tmp/ownsh-redirect.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+echo input > "$WORK/in"
+
+run()
+{
+      local name=$1 line=$2
+      local start end
+      yes "$line" | head -n "$N" > "$WORK/script"
+      start=$(date +%s%N)
+      "$SHELL_BIN" "$WORK/script" > /dev/null 2>&1
+      end=$(date +%s%N)
+      echo "$name $((end - start))"
+}
+
+{
+      run plain "/bin/true"
+      run redirect_out "/bin/true > $WORK/out"
+      run redirect_in "/bin/true < $WORK/in"
+} | awk -v n="$N" '
+      $1 == "plain" { plain = $2 }
+      { printf "{\"benchmark\":\"%s\",\"count\":%d,\"per_op_us\":%.2f,\"overhead_us\":%.2f}\n", $1 == "plain" ? "redirect_none" : $1, n, $2 / 1e3 / n, ($2 - plain) / 1e3 / n }'
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Builds the shell once and runs the benchmark suites. Every measurement is
+# one JSON object per line, tagged with the commit and the time of the run,
+# so the output of two runs can be appended to one file and compared.
+#
+#   ./benchmarks/run.sh [suite...] > results.jsonl
+#
+# Suites: spawn pipeline redirect parse listing glob (the default set), and
+# substitution zygote serve startup. "all" runs every suite. Arguments for
+# a suite can be passed through the environment, for example
+# LISTING_ARGS="1000 100000" to skip the million-file directory.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+export SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+DEFAULT="spawn pipeline redirect parse listing glob"
+SUITES=${*:-$DEFAULT}
+[ "$SUITES" = "all" ] && SUITES="$DEFAULT substitution zygote serve startup"
+
+gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+export NO_BUILD=1
+
+COMMIT=$(git -C "$ROOT" rev-parse --short HEAD 2> /dev/null || echo unknown)
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+STATUS=0
+for suite in $SUITES; do
+      if [ ! -x "$ROOT/benchmarks/$suite.sh" ]; then
+            echo "run.sh: no suite $suite" >&2
+            STATUS=1
+            continue
+      fi
+      args=$(echo "$suite" | tr a-z A-Z)_ARGS
+      echo "run.sh: $suite" >&2
+      "$ROOT/benchmarks/$suite.sh" ${!args} | sed "s/^{/{\"commit\":\"$COMMIT\",\"date\":\"$DATE\",\"suite\":\"$suite\",/" || STATUS=1
+done
+exit $STATUS
@@ -0,0 +1,23 @@
+#!/bin/bash
+# Starts "ownsh --serve" on a temporary socket and drives it with
+# serve_load, once with a builtin and once with an external command.
+#
+#   ./benchmarks/serve.sh [clients] [requests per client]      (defaults 8 and 1000)
+
+CLIENTS=${1:-8}
+REQUESTS=${2:-1000}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+LOAD_BIN=${LOAD_BIN:-/tmp/serve_load}
+SOCKET=$(mktemp -u /tmp/ownsh-serve.XXXXXX)
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+gcc -O2 -o "$LOAD_BIN" "$ROOT/benchmarks/serve_load.c" || exit 1
+
+"$SHELL_BIN" --serve "$SOCKET" &
+SERVER=$!
+trap 'kill $SERVER; rm -f "$SOCKET"' EXIT
+while [ ! -S "$SOCKET" ]; do sleep 0.01; done
+
+"$LOAD_BIN" "$SOCKET" "$CLIENTS" "$REQUESTS" "echo hello"
+"$LOAD_BIN" "$SOCKET" "$CLIENTS" "$REQUESTS" "/bin/echo hello"
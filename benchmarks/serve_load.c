@@ -0,0 +1,144 @@
+/*
+  Load generator for "ownsh --serve". Starts a number of client processes,
+  each with its own connection, that send the same command back to back and
+  time every request until its X frame arrives. Prints requests per second
+  and latency percentiles as one JSON line.
+
+    serve_load <socket> [clients] [requests per client] [command]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static int transfer(int fd, char *data, size_t length, int writing)
+{
+      while(length > 0)
+      {
+            ssize_t n = writing ? write(fd, data, length) : read(fd, data, length);
+            if(n <= 0)
+                  return -1;
+            data += n;
+            length -= n;
+      }
+      return 0;
+}
+
+static int writeFrame(int fd, char type, const char *data, uint32_t length)
+{
+      unsigned char header[5] = {type, length >> 24, length >> 16, length >> 8, length};
+
+      if(transfer(fd, (char *)header, 5, 1) < 0)
+            return -1;
+      return transfer(fd, (char *)data, length, 1);
+}
+
+static double nowNs(void)
+{
+      struct timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int compare(const void *a, const void *b)
+{
+      double x = *(const double *)a, y = *(const double *)b;
+      return x < y ? -1 : x > y;
+}
+
+//Runs one client. Returns the number of failed requests.
+static int client(char *path, char *command, int requests, double *latency)
+{
+      struct sockaddr_un address;
+      char buffer[65536];
+      int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      int i, failed = 0;
+
+      memset(&address, 0, sizeof(address));
+      address.sun_family = AF_UNIX;
+      strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+      if(fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+      {
+            perror("serve_load");
+            return requests;
+      }
+      for(i = 0 ; i < requests ; i++)
+      {
+            double start = nowNs();
+            unsigned char header[5];
+            uint32_t length;
+
+            latency[i] = -1;
+            if(writeFrame(fd, 'C', command, strlen(command)) < 0 || writeFrame(fd, 'R', "", 0) < 0)
+                  return requests - i;
+            do
+            {
+                  if(transfer(fd, (char *)header, 5, 0) < 0)
+                        return requests - i;
+                  length = (uint32_t)header[1] << 24 | header[2] << 16 | header[3] << 8 | header[4];
+                  while(length > 0)
+                  {
+                        uint32_t chunk = length < sizeof(buffer) ? length : sizeof(buffer);
+                        if(transfer(fd, buffer, chunk, 0) < 0)
+                              return requests - i;
+                        length -= chunk;
+                  }
+            }while(header[0] != 'X');
+            if(strncmp(buffer, "0 ", 2) != 0)
+                  failed++;
+            latency[i] = nowNs() - start;
+      }
+      close(fd);
+      return failed;
+}
+
+int main(int argc, char **argv)
+{
+      if(argc < 2)
+      {
+            fprintf(stderr, "usage: serve_load <socket> [clients] [requests per client] [command]\n");
+            return 1;
+      }
+      char *path = argv[1];
+      int clients = argc > 2 ? atoi(argv[2]) : 8;
+      int requests = argc > 3 ? atoi(argv[3]) : 1000;
+      char *command = argc > 4 ? argv[4] : "echo hello";
+      size_t total = (size_t)clients * requests;
+      double *latency = mmap(NULL, sizeof(double) * total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      int i, status, failed = 0, done = 0;
+      double start, elapsed;
+
+      if(latency == MAP_FAILED)
+      {
+            perror("serve_load");
+            return 1;
+      }
+      start = nowNs();
+      for(i = 0 ; i < clients ; i++)
+      {
+            if(fork() == 0)
+                  _exit(client(path, command, requests, latency + (size_t)i * requests) > 0);
+      }
+      while(wait(&status) > 0)
+            failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+      elapsed = nowNs() - start;
+
+      for(size_t j = 0 ; j < total ; j++)
+      {
+            if(latency[j] >= 0)
+                  latency[done++] = latency[j];
+      }
+      qsort(latency, done, sizeof(double), compare);
+      printf("{\"benchmark\":\"serve\",\"clients\":%d,\"requests\":%d,\"failed_clients\":%d,\"rps\":%.1f,"
+            "\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+            clients, done, failed, done / (elapsed / 1e9),
+            done ? latency[done / 2] / 1e3 : 0, done ? latency[(size_t)(done * 0.99)] / 1e3 : 0,
+            done ? latency[done - 1] / 1e3 : 0);
+      return failed != 0;
+}
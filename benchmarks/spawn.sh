@@ -0,0 +1,31 @@
+#!/bin/bash
+# Spawn latency of single external commands through sst_launch. A script of
+# N lines is run with "ownsh script", so neither a prompt nor the terminal
+# is involved, and the cost of the same script with a builtin is reported
+# alongside as the shell's own share.
+#
+#   ./benchmarks/spawn.sh [N]      (N defaults to 5000)
+
+N=${1:-5000}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+WORK=$(mktemp -d /tmp/ownsh-spawn.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+
+run()
+{
+      local name=$1 line=$2
+      local start end
+      yes "$line" | head -n "$N" > "$WORK/script"
+      start=$(date +%s%N)
+      "$SHELL_BIN" "$WORK/script" > /dev/null 2>&1
+      end=$(date +%s%N)
+      awk -v name="$name" -v n="$N" -v ns=$((end - start)) \
+            'BEGIN { printf "{\"benchmark\":\"%s\",\"count\":%d,\"total_ms\":%.1f,\"per_op_us\":%.2f}\n", name, n, ns / 1e6, ns / 1e3 / n }'
+}
+
+run spawn_builtin 'echo -n'
+run spawn_external '/bin/true'
+run spawn_path_lookup 'true'
@@ -0,0 +1,37 @@
+#!/bin/bash
+# Time to first command with an rc file of N aliases, once running the rc
+# file on every start (SST_NO_SNAPSHOT=1) and once restoring the startup
+# snapshot. Each launch runs a single builtin and exits.
+#
+#   ./benchmarks/startup.sh [aliases] [launches]      (defaults 5000 and 200)
+
+ALIASES=${1:-5000}
+LAUNCHES=${2:-200}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+WORK=$(mktemp -d /tmp/ownsh-startup.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+
+for i in $(seq "$ALIASES"); do
+      echo "alias a$i=\"ls -l dir$i\""
+done > "$WORK/ownshrc"
+export SST_RC="$WORK/ownshrc" XDG_CACHE_HOME="$WORK/cache"
+
+run()
+{
+      local name=$1
+      local start end
+      echo "echo ready" | "$SHELL_BIN" > /dev/null 2>&1 #writes the snapshot
+      start=$(date +%s%N)
+      for i in $(seq "$LAUNCHES"); do
+            echo "echo ready" | "$SHELL_BIN" > /dev/null 2>&1
+      done
+      end=$(date +%s%N)
+      awk -v name="$name" -v n="$LAUNCHES" -v aliases="$ALIASES" -v ns=$((end - start)) \
+            'BEGIN { printf "{\"benchmark\":\"%s\",\"aliases\":%d,\"launches\":%d,\"per_launch_ms\":%.3f}\n", name, aliases, n, ns / 1e6 / n }'
+}
+
+SST_NO_SNAPSHOT=1 run startup_rc
+run startup_snapshot
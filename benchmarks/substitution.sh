@@ -0,0 +1,26 @@
+#!/bin/bash
+# Times command substitution in the shell. Each run feeds N lines of the
+# form "echo $(...)" on stdin and reports the cost per substitution for the
+# in-process builtin path and for the fork + pipe path.
+#
+#   ./benchmarks/substitution.sh [N]      (N defaults to 100000)
+
+N=${1:-100000}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+
+run()
+{
+      local name=$1 line=$2
+      local start end
+      start=$(date +%s%N)
+      yes "$line" | head -n "$N" | "$SHELL_BIN" > /dev/null 2>&1
+      end=$(date +%s%N)
+      awk -v name="$name" -v n="$N" -v ns=$((end - start)) \
+            'BEGIN { printf "{\"benchmark\":\"%s\",\"count\":%d,\"total_ms\":%.1f,\"per_op_us\":%.2f}\n", name, n, ns / 1e6, ns / 1e3 / n }'
+}
+
+run substitution_builtin 'echo $(echo hello)'
+run substitution_fork 'echo $(/bin/echo hello)'
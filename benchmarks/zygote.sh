@@ -0,0 +1,36 @@
+#!/bin/bash
+# Compares forking commands from the shell with spawning them through the
+# zygote once the shell has grown to a large RSS. The ballast.c shim pads
+# the shell with BALLAST_MB of touched memory after its first fork, which
+# starts the zygote, then the shell runs N commands; spawn latency
+# percentiles come from shellstat.
+#
+#   ./benchmarks/zygote.sh [N] [ballast MB]      (defaults 2000 and 1024)
+
+N=${1:-2000}
+BALLAST=${2:-1024}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SHELL_BIN=${SHELL_BIN:-/tmp/ownsh-bench}
+BALLAST_LIB=${BALLAST_LIB:-/tmp/ownsh-ballast.so}
+
+[ -n "$NO_BUILD" ] || gcc -O2 -o "$SHELL_BIN" "$ROOT/Own Shell.c" || exit 1
+gcc -O2 -shared -fPIC -o "$BALLAST_LIB" "$ROOT/benchmarks/ballast.c" -ldl || exit 1
+
+run()
+{
+      local name=$1 zygote=$2
+      local start end
+      start=$(date +%s%N)
+      { yes /bin/true | head -n "$N"; echo shellstat; } |
+            SST_ZYGOTE=$zygote BALLAST_MB=$BALLAST LD_PRELOAD=$BALLAST_LIB "$SHELL_BIN" 2>&1 |
+            awk -v name="$name" -v n="$N" -v start="$start" -v ballast="$BALLAST" '
+                  $1 == "spawn" { mean = $3; p50 = $4; p99 = $6 }
+                  END {
+                        "date +%s%N" | getline end
+                        printf "{\"benchmark\":\"%s\",\"count\":%d,\"ballast_mb\":%d,\"spawn_mean_us\":%.1f,\"spawn_p50_us\":%d,\"spawn_p99_us\":%d,\"per_command_us\":%.1f}\n",
+                              name, n, ballast, mean, p50, p99, (end - start) / 1e3 / n
+                  }'
+}
+
+run spawn_fork 0
+run spawn_zygote 1